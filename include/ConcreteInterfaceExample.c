@@ -466,5 +466,11 @@ int main( void )
 		printf( "%s says: '%s' (compactness: %.02f)\n", animal->name, text, CALL( Animal, compactness, animal ) );
 	}
 
+	// Big mixed arrays are cheaper to work through one implementation at
+	// a time: INVOKE_EACH sorts them into runs (in place!), then calls a
+	// whole run through the same method pointer.
+	INVOKE_EACH( Animal, animals, 2, speak, text, 100 );
+	printf( "The last to speak said: '%s'\n", text );
+
 	return 0;
 }
@@ -369,6 +369,118 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define INVOKE( object, method, ... )	\
 	(object)->vtable->method( object, ## __VA_ARGS__ )
 
+/** Calls an interface's virtual method, directly if object is of the
+ * expected implementation.
+ *
+ * Where one implementation dominates a call site, the vtable comparison
+ * lets the compiler inline that implementation's method, and vectorize
+ * loops around it. Other implementations take the indirect call, as with
+ * INVOKE. The implementation's vtable and method must be declared in
+ * scope, and defined there for inlining. Evaluates object more than once.
+ *
+ * @param object interface instance.
+ * @param implementation expected implementation of object.
+ * @param method name of virtual method to invoke.
+ * @param __VA_ARGS__ method specific arguments.
+ * @return method specific result.
+ */
+#define INVOKE_EXPECT( object, implementation, method, ... )	\
+	( LIKELY( INTERFACE_IS_INSTANCE( implementation, object ) ) ?	\
+		INTERFACE_METHOD_NAME( implementation, method )( object, ## __VA_ARGS__ ) :	\
+		INVOKE( object, method, ## __VA_ARGS__ ) )
+
+/** Groups an array of interface instances by implementation, in place.
+ *
+ * Implementations appear in the order of their first instance. Instances
+ * of the first keep their relative order; others may not. Costs a pass
+ * over the array per implementation, even if it is already grouped.
+ *
+ * @param interface of the instances.
+ * @param objects array of interface instance pointers.
+ * @param count number of instances.
+ */
+#define INTERFACE_GROUP( interface, objects, count )	\
+	do {	\
+		interface ** const group_objects = (objects);	\
+		const size_t group_count = (count);	\
+		size_t group_start, group_end, group_scan;	\
+		interface * group_swap;	\
+		for( group_start = 0; group_start < group_count; group_start = group_end ) {	\
+			group_end = group_start + 1;	\
+			for( group_scan = group_end; group_scan < group_count; group_scan++ ) {	\
+				if( group_objects[ group_scan ]->vtable != group_objects[ group_start ]->vtable )	\
+					continue;	\
+				group_swap = group_objects[ group_end ];	\
+				group_objects[ group_end++ ] = group_objects[ group_scan ];	\
+				group_objects[ group_scan ] = group_swap;	\
+			}	\
+		}	\
+	} while( 0 )
+
+/** Calls an interface's virtual method on each instance in an array, in
+ * runs of one implementation.
+ *
+ * Groups the array in place with INTERFACE_GROUP(), then calls each run
+ * through a single method pointer, so the indirect call is predicted for
+ * all but the first instance of a run. Results are discarded.
+ *
+ * @param interface of the instances.
+ * @param objects array of interface instance pointers.
+ * @param count number of instances.
+ * @param method name of virtual method to invoke.
+ * @param __VA_ARGS__ method specific arguments, shared by every call.
+ */
+#define INVOKE_EACH( interface, objects, count, method, ... )	\
+	do {	\
+		interface ** const each_objects = (objects);	\
+		const size_t each_count = (count);	\
+		size_t each_start, each_end;	\
+		INTERFACE_METHOD_SIGNATURE( interface, method )( * each_method );	\
+		INTERFACE_GROUP( interface, each_objects, each_count );	\
+		for( each_start = 0; each_start < each_count; each_start = each_end ) {	\
+			each_method = each_objects[ each_start ]->vtable->method;	\
+			for( each_end = each_start; each_end < each_count &&	\
+			    each_objects[ each_end ]->vtable == each_objects[ each_start ]->vtable;	\
+			    each_end++ )	\
+				each_method( each_objects[ each_end ], ## __VA_ARGS__ );	\
+		}	\
+	} while( 0 )
+
+/** Calls an interface's virtual batch method once per run of instances of
+ * one implementation.
+ *
+ * Batch methods are ordinary methods of interfaces that choose to define
+ * them, taking the run and its length in place of self:
+ *
+ *    #define MyInterface__signature_myMethodEach( name ) \
+ *        void (name)( MyInterface * const * objects, size_t count, ... )
+ *
+ * An implementation's batch method can then loop over the run calling its
+ * own methods with CALL(), which the compiler may inline and vectorize.
+ * Groups the array in place with INTERFACE_GROUP().
+ *
+ * @param interface of the instances.
+ * @param objects array of interface instance pointers.
+ * @param count number of instances.
+ * @param method name of virtual batch method to invoke.
+ * @param __VA_ARGS__ method specific arguments, shared by every call.
+ */
+#define INVOKE_EACH_BATCH( interface, objects, count, method, ... )	\
+	do {	\
+		interface ** const each_objects = (objects);	\
+		const size_t each_count = (count);	\
+		size_t each_start, each_end;	\
+		INTERFACE_GROUP( interface, each_objects, each_count );	\
+		for( each_start = 0; each_start < each_count; each_start = each_end ) {	\
+			for( each_end = each_start + 1; each_end < each_count &&	\
+			    each_objects[ each_end ]->vtable == each_objects[ each_start ]->vtable;	\
+			    each_end++ )	\
+				;	\
+			each_objects[ each_start ]->vtable->method(	\
+			    &each_objects[ each_start ], each_end - each_start, ## __VA_ARGS__ );	\
+		}	\
+	} while( 0 )
+
 
 /** Initializes an interface object's vtable. */
 #define INTERFACE_INIT_AS( interface, implementation, object )	\
@@ -50,6 +50,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	type symbol = (type) ptr
 
 
+/** Hints that expression is usually true, for branch layout. */
+#ifndef LIKELY
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define LIKELY( expression )	__builtin_expect( !!( expression ), 1 )
+#else
+#define LIKELY( expression )	( expression )
+#endif
+#endif /* LIKELY */
+
 #ifndef container_of
 #define container_of( ptr, type, member )	\
 	(( (type*) ((size_t)ptr - offsetof( type, member ) ) ))
@@ -0,0 +1,513 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Microbenchmarks for the queue.h list families, with arrays as a baseline.
+ *
+ * Build with optimization and run, optionally naming the element counts to
+ * measure:
+ *
+ *	cc -O2 -o QueueBenchmark QueueBenchmark.c
+ *	./QueueBenchmark [count ...]
+ *
+ * Every list is threaded through the same pool of cache-line sized nodes,
+ * so the families differ only in their linkage. Each count is measured with
+ * two placements of the list order in the pool: sequential, where the next
+ * node is usually the adjacent one and the hardware prefetcher keeps up,
+ * and shuffled, where every hop is a dependent load from an unpredictable
+ * address, as happens to long-lived lists in a fragmented heap.
+ *
+ * For each container the table reports the best of BENCH_TRIALS runs in
+ * nanoseconds per element, and two cache-miss proxies: hardware cache
+ * misses per element, read from perf_event_open(2) where the kernel allows
+ * it, and, for each placement, the share of hops that leave the adjacent
+ * cache lines, which bounds what the prefetcher can hide.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "queue.h"
+
+/* Elements touched per measurement; small counts are repeated to reach it. */
+#ifndef BENCH_WORK
+#define	BENCH_WORK	(1UL << 21)
+#endif
+
+#ifndef BENCH_TRIALS
+#define	BENCH_TRIALS	3
+#endif
+
+struct node {
+	long value;
+	SLIST_ENTRY(node) slist;
+	STAILQ_ENTRY(node) stailq;
+	DLIST_ENTRY(node) dlist;
+	TAILQ_ENTRY(node) tailq;
+} QUEUE_CACHE_ALIGNED;
+
+struct bench_result {
+	double ns;		/* per element */
+	double misses;		/* per element, negative if unavailable */
+};
+
+typedef void (*bench_fn)(size_t count);
+
+static struct node *pool;
+static struct node **order;	/* list order, a placement of the pool */
+static struct node **victims;	/* removal order, independent of placement */
+static long *values;		/* array baseline */
+static size_t reps;
+static volatile long sink;
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t
+bench_random(void)
+{
+
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (seed);
+}
+
+static void
+bench_shuffle(struct node **array, size_t count)
+{
+	struct node *tmp;
+	size_t index, other;
+
+	for (index = count; index > 1; index--) {
+		other = bench_random() % index;
+		tmp = array[index - 1];
+		array[index - 1] = array[other];
+		array[other] = tmp;
+	}
+}
+
+static uint64_t
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+#ifdef __linux__
+static int bench_perf_fd = -1;
+
+static void
+bench_perf_open(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	bench_perf_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void
+bench_perf_start(void)
+{
+
+	if (bench_perf_fd < 0)
+		return;
+	ioctl(bench_perf_fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(bench_perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/* Returns the misses since bench_perf_start(), or -1. */
+static long long
+bench_perf_stop(void)
+{
+	long long misses;
+
+	if (bench_perf_fd < 0)
+		return (-1);
+	ioctl(bench_perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(bench_perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+		return (-1);
+	return (misses);
+}
+#else
+#define	bench_perf_open()
+#define	bench_perf_start()
+#define	bench_perf_stop()	(-1LL)
+#endif /* __linux__ */
+
+/*
+ * Runs body reps times per trial, each after an untimed setup, and keeps the
+ * fastest trial.
+ */
+static void
+bench_measure(struct bench_result *result, bench_fn setup, bench_fn body,
+    size_t count)
+{
+	uint64_t best, elapsed, start;
+	long long misses, total;
+	size_t rep;
+	int trial;
+
+	best = UINT64_MAX;
+	result->misses = -1;
+	for (trial = 0; trial < BENCH_TRIALS; trial++) {
+		elapsed = 0;
+		total = 0;
+		for (rep = 0; rep < reps; rep++) {
+			if (setup != NULL)
+				setup(count);
+			bench_perf_start();
+			start = bench_now();
+			body(count);
+			elapsed += bench_now() - start;
+			misses = bench_perf_stop();
+			total = (misses < 0 || total < 0) ? -1 : total + misses;
+		}
+		if (elapsed < best) {
+			best = elapsed;
+			result->misses = total < 0 ? -1 :
+			    (double)total / ((double)count * reps);
+		}
+	}
+	result->ns = (double)best / ((double)count * reps);
+}
+
+static void
+bench_report(const char *container, const char *operation,
+    const struct bench_result *result)
+{
+
+	if (result->misses < 0)
+		printf("  %-8s %-16s %9.2f %12s\n", container, operation,
+		    result->ns, "-");
+	else
+		printf("  %-8s %-16s %9.2f %12.3f\n", container, operation,
+		    result->ns, result->misses);
+}
+
+/* Share of hops in list order that skip past the adjacent cache lines. */
+static double
+bench_far_hops(size_t count)
+{
+	size_t far, index;
+	intptr_t delta;
+
+	far = 0;
+	for (index = 1; index < count; index++) {
+		delta = (char *)order[index] - (char *)order[index - 1];
+		if (delta < -2 * QUEUE_CACHE_LINE_SIZE ||
+		    delta > 2 * QUEUE_CACHE_LINE_SIZE)
+			far++;
+	}
+	return (count > 1 ? 100.0 * far / (count - 1) : 0);
+}
+
+/*
+ * The operations each family is measured with: building the list in order[]
+ * order, draining it from the front, and removing victims[] one by one,
+ * which only the doubly-linked families do in constant time.
+ */
+#define	SLIST_BENCH_INSERT(head, elm)					\
+	SLIST_INSERT_HEAD(head, elm, slist)
+#define	SLIST_BENCH_REMOVE_FIRST(head)					\
+	SLIST_REMOVE_HEAD(head, slist)
+#define	STAILQ_BENCH_INSERT(head, elm)					\
+	STAILQ_INSERT_TAIL(head, elm, stailq)
+#define	STAILQ_BENCH_REMOVE_FIRST(head)					\
+	STAILQ_REMOVE_HEAD(head, stailq)
+#define	DLIST_BENCH_INSERT(head, elm)					\
+	DLIST_INSERT_HEAD(head, elm, dlist)
+#define	DLIST_BENCH_REMOVE_FIRST(head)					\
+	DLIST_REMOVE(DLIST_FIRST(head), dlist)
+#define	DLIST_BENCH_REMOVE(head, elm)					\
+	DLIST_REMOVE(elm, dlist)
+#define	TAILQ_BENCH_INSERT(head, elm)					\
+	TAILQ_INSERT_TAIL(head, elm, tailq)
+#define	TAILQ_BENCH_REMOVE_FIRST(head)					\
+	TAILQ_REMOVE(head, TAILQ_FIRST(head), tailq)
+#define	TAILQ_BENCH_REMOVE(head, elm)					\
+	TAILQ_REMOVE(head, elm, tailq)
+
+/* Head-inserting families are built back to front to end up in order. */
+#define	BENCH_LIST_GENERATE(family, field, backwards)			\
+static family##_HEAD(, node) bench_##field##_head;				\
+									\
+static void								\
+bench_##field##_insert(size_t count)					\
+{									\
+	size_t index;							\
+									\
+	family##_INIT(&bench_##field##_head);					\
+	for (index = 0; index < count; index++)				\
+		family##_BENCH_INSERT(&bench_##field##_head,			\
+		    order[(backwards) ? count - 1 - index : index]);	\
+}									\
+									\
+static void								\
+bench_##field##_iterate(size_t count)					\
+{									\
+	struct node *var;						\
+	long sum;							\
+									\
+	(void)count;							\
+	sum = 0;							\
+	family##_FOREACH(var, &bench_##field##_head, field)			\
+		sum += var->value;					\
+	sink = sum;							\
+}									\
+									\
+static void								\
+bench_##field##_iterate_prefetch(size_t count)				\
+{									\
+	struct node *var;						\
+	void *ahead;							\
+	long sum;							\
+									\
+	(void)count;							\
+	sum = 0;							\
+	family##_FOREACH_PREFETCH(var, &bench_##field##_head, field, ahead)	\
+		sum += var->value;					\
+	sink = sum;							\
+}									\
+									\
+static void								\
+bench_##field##_remove_first(size_t count)				\
+{									\
+									\
+	(void)count;							\
+	while (!family##_EMPTY(&bench_##field##_head))				\
+		family##_BENCH_REMOVE_FIRST(&bench_##field##_head);		\
+}									\
+									\
+static void								\
+bench_##field(size_t count)						\
+{									\
+	struct bench_result result;					\
+									\
+	bench_measure(&result, NULL, bench_##field##_insert, count);	\
+	bench_report(#family, "insert", &result);			\
+	bench_measure(&result, NULL, bench_##field##_iterate, count);	\
+	bench_report(#family, "iterate", &result);			\
+	bench_measure(&result, NULL, bench_##field##_iterate_prefetch,	\
+	    count);							\
+	bench_report(#family, "iterate prefetch", &result);		\
+	bench_measure(&result, bench_##field##_insert,			\
+	    bench_##field##_remove_first, count);			\
+	bench_report(#family, "remove first", &result);			\
+}
+
+#define	BENCH_LIST_GENERATE_REMOVE(family, field)			\
+static void								\
+bench_##field##_remove(size_t count)					\
+{									\
+	size_t index;							\
+									\
+	for (index = 0; index < count; index++)				\
+		family##_BENCH_REMOVE(&bench_##field##_head, victims[index]);	\
+}									\
+									\
+static void								\
+bench_##field##_random(size_t count)					\
+{									\
+	struct bench_result result;					\
+									\
+	bench_measure(&result, bench_##field##_insert,			\
+	    bench_##field##_remove, count);				\
+	bench_report(#family, "remove any", &result);			\
+}
+
+BENCH_LIST_GENERATE(SLIST, slist, 1)
+BENCH_LIST_GENERATE(STAILQ, stailq, 0)
+BENCH_LIST_GENERATE(DLIST, dlist, 1)
+BENCH_LIST_GENERATE_REMOVE(DLIST, dlist)
+BENCH_LIST_GENERATE(TAILQ, tailq, 0)
+BENCH_LIST_GENERATE_REMOVE(TAILQ, tailq)
+
+static void
+bench_array_push(size_t count)
+{
+	size_t index;
+
+	for (index = 0; index < count; index++)
+		values[index] = (long)index;
+}
+
+static void
+bench_array_iterate(size_t count)
+{
+	size_t index;
+	long sum;
+
+	sum = 0;
+	for (index = 0; index < count; index++)
+		sum += values[index];
+	sink = sum;
+}
+
+static void
+bench_array_pop(size_t count)
+{
+	long sum;
+
+	sum = 0;
+	while (count > 0)
+		sum += values[--count];
+	sink = sum;
+}
+
+/* An array of pointers into the pool: placement-bound, but not a chain. */
+static void
+bench_pointers_iterate(size_t count)
+{
+	size_t index;
+	long sum;
+
+	sum = 0;
+	for (index = 0; index < count; index++)
+		sum += order[index]->value;
+	sink = sum;
+}
+
+static void
+bench_arrays(size_t count)
+{
+	struct bench_result result;
+
+	bench_measure(&result, NULL, bench_array_push, count);
+	bench_report("array", "push", &result);
+	bench_measure(&result, NULL, bench_array_iterate, count);
+	bench_report("array", "iterate", &result);
+	bench_measure(&result, NULL, bench_array_pop, count);
+	bench_report("array", "pop", &result);
+	bench_measure(&result, NULL, bench_pointers_iterate, count);
+	bench_report("pointers", "iterate", &result);
+}
+
+static void
+bench_placement(const char *placement, size_t count)
+{
+
+	printf("%zu elements, %s placement, %.1f%% far hops\n", count,
+	    placement, bench_far_hops(count));
+	printf("  %-8s %-16s %9s %12s\n", "", "", "ns/elem", "misses/elem");
+	bench_slist(count);
+	bench_stailq(count);
+	bench_dlist(count);
+	bench_dlist_random(count);
+	bench_tailq(count);
+	bench_tailq_random(count);
+	bench_arrays(count);
+	printf("\n");
+}
+
+static int
+bench_count(size_t count)
+{
+	size_t index;
+
+	pool = aligned_alloc(QUEUE_CACHE_LINE_SIZE, count * sizeof(*pool));
+	order = malloc(count * sizeof(*order));
+	victims = malloc(count * sizeof(*victims));
+	values = malloc(count * sizeof(*values));
+	if (pool == NULL || order == NULL || victims == NULL ||
+	    values == NULL) {
+		fprintf(stderr, "out of memory for %zu elements\n", count);
+		free(pool);
+		free(order);
+		free(victims);
+		free(values);
+		return (-1);
+	}
+	memset(pool, 0, count * sizeof(*pool));
+	for (index = 0; index < count; index++) {
+		pool[index].value = (long)index;
+		order[index] = &pool[index];
+		victims[index] = &pool[index];
+	}
+	bench_shuffle(victims, count);
+	reps = count < BENCH_WORK ? BENCH_WORK / count : 1;
+
+	bench_placement("sequential", count);
+	bench_shuffle(order, count);
+	bench_placement("shuffled", count);
+
+	free(pool);
+	free(order);
+	free(victims);
+	free(values);
+	return (0);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const size_t defaults[] = { 1 << 10, 1 << 14, 1 << 17,
+	    1 << 20 };
+	size_t count, index;
+	int status;
+
+	bench_perf_open();
+	printf("%zu-byte nodes, best of %d trials, hardware cache misses %s\n\n",
+	    sizeof(struct node), BENCH_TRIALS,
+	    bench_perf_stop() < 0 ? "unavailable" : "available");
+	status = 0;
+	if (argc > 1) {
+		for (index = 1; index < (size_t)argc; index++) {
+			count = strtoul(argv[index], NULL, 0);
+			if (count == 0) {
+				fprintf(stderr, "bad count: %s\n", argv[index]);
+				return (1);
+			}
+			if (bench_count(count) != 0)
+				status = 1;
+		}
+	} else {
+		for (index = 0; index < sizeof(defaults) / sizeof(defaults[0]); index++)
+			if (bench_count(defaults[index]) != 0)
+				status = 1;
+	}
+	return (status);
+}
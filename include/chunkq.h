@@ -0,0 +1,291 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "queue.h"
+#include "../interfaces/Allocator.h"
+
+/*
+ * Chunked queues.
+ *
+ * A chunked queue is a FIFO of small values, such as indices or pointers,
+ * stored by value in a list of cache-line-aligned chunks of CHUNKQ_CHUNK_SIZE
+ * bytes, each holding as many values as fit after its link. Compared to a
+ * STAILQ of one node per value this saves the per-value link and
+ * allocation, and a drain walks memory sequentially, missing the cache once
+ * per line rather than once per value.
+ *
+ * Values are pushed at the last chunk and popped from the first. A chunk
+ * emptied by popping is kept as a spare for the next push that needs one,
+ * so a queue that stays about the same length stops allocating. Chunk
+ * memory comes from an Allocator instance. Bulk append and drain copy whole
+ * runs within a chunk at a time.
+ *
+ * Functions are emitted per queue type by CHUNKQ_GENERATE():
+ *
+ *	CHUNKQ_HEAD(indexq, uint32_t);
+ *	CHUNKQ_GENERATE(indexq, uint32_t)
+ *
+ *	struct indexq queue;
+ *	CHUNKQ_INIT(indexq, &queue, allocator);
+ *	CHUNKQ_APPEND(indexq, &queue, indices, count);
+ *	while ((n = CHUNKQ_DRAIN(indexq, &queue, batch, 64)) != 0)
+ *		...
+ */
+#ifndef CHUNKQ_CHUNK_SIZE
+#define	CHUNKQ_CHUNK_SIZE	(4 * QUEUE_CACHE_LINE_SIZE)
+#endif
+
+/* Values per chunk: whatever fits after the two chunk pointers. */
+#define	CHUNKQ_ITEMS(type)						\
+	((CHUNKQ_CHUNK_SIZE - 2 * sizeof(void *)) / sizeof(type) > 0 ?	\
+	    (CHUNKQ_CHUNK_SIZE - 2 * sizeof(void *)) / sizeof(type) : 1)
+
+/*
+ * Chunked queue declarations.
+ */
+#define	CHUNKQ_CHUNK(name)	struct name##_chunk
+
+#define	CHUNKQ_HEAD(name, type)						\
+CHUNKQ_CHUNK(name) {							\
+	CHUNKQ_CHUNK(name) *cc_next;	/* next chunk to pop from */	\
+	void *cc_memory;		/* allocation holding us */	\
+	type cc_items[CHUNKQ_ITEMS(type)];				\
+} QUEUE_CACHE_ALIGNED;							\
+struct name {								\
+	CHUNKQ_CHUNK(name) *cq_first;	/* pop end */			\
+	CHUNKQ_CHUNK(name) *cq_last;	/* push end */			\
+	CHUNKQ_CHUNK(name) *cq_spare;	/* emptied chunk for reuse */	\
+	size_t cq_head;			/* next index to pop */		\
+	size_t cq_tail;			/* next index to push */	\
+	size_t cq_count;		/* values queued */		\
+	Allocator *cq_allocator;	/* source of chunks */		\
+}
+
+/*
+ * Chunked queue functions.
+ */
+#define	CHUNKQ_COUNT(queue)	((queue)->cq_count)
+#define	CHUNKQ_EMPTY(queue)	((queue)->cq_count == 0)
+
+/* Pointer to the oldest value, or NULL if empty. */
+#define	CHUNKQ_FIRST(queue)						\
+	((queue)->cq_count != 0 ?					\
+	    &(queue)->cq_first->cc_items[(queue)->cq_head] : NULL)
+
+#define	CHUNKQ_INIT(name, queue, allocator)				\
+	name##_CHUNKQ_INIT((queue), (allocator))
+#define	CHUNKQ_DESTROY(name, queue)	name##_CHUNKQ_DESTROY((queue))
+#define	CHUNKQ_PUSH(name, queue, elm)	name##_CHUNKQ_PUSH((queue), (elm))
+#define	CHUNKQ_POP(name, queue, elmp)	name##_CHUNKQ_POP((queue), (elmp))
+#define	CHUNKQ_APPEND(name, queue, elms, n)				\
+	name##_CHUNKQ_APPEND((queue), (elms), (n))
+#define	CHUNKQ_DRAIN(name, queue, elms, max)				\
+	name##_CHUNKQ_DRAIN((queue), (elms), (max))
+
+/*
+ * Emits the queue functions for struct name holding values of type:
+ *
+ *  - _CHUNKQ_INIT empties the queue without allocating. _CHUNKQ_DESTROY
+ *    frees every chunk, discarding queued values, and returns the
+ *    allocator's status.
+ *  - _CHUNKQ_PUSH appends elm and returns the allocator's status.
+ *  - _CHUNKQ_POP moves the oldest value to *elmp and returns 1, or returns
+ *    0 if empty.
+ *  - _CHUNKQ_APPEND appends n values from elms in order and returns the
+ *    allocator's status; on failure, the values before the one that needed
+ *    a chunk stay queued.
+ *  - _CHUNKQ_DRAIN moves up to max of the oldest values to elms and
+ *    returns how many it moved.
+ */
+#define	CHUNKQ_GENERATE(name, type)					\
+static __inline __unused void						\
+name##_CHUNKQ_INIT(struct name *queue, Allocator *allocator)		\
+{									\
+	queue->cq_first = queue->cq_last = queue->cq_spare = NULL;	\
+	queue->cq_head = queue->cq_tail = queue->cq_count = 0;		\
+	queue->cq_allocator = allocator;				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_CHUNKQ_DESTROY(struct name *queue)				\
+{									\
+	CHUNKQ_CHUNK(name) *chunk, *next;				\
+	AllocatorStatusType status = AllocatorStatusSuccess;		\
+	void *memory;							\
+									\
+	if ((chunk = queue->cq_spare) != NULL)				\
+		chunk->cc_next = queue->cq_first;			\
+	else								\
+		chunk = queue->cq_first;				\
+	for (; chunk != NULL; chunk = next) {				\
+		next = chunk->cc_next;					\
+		memory = chunk->cc_memory;				\
+		if (INVOKE(queue->cq_allocator, free, &memory,		\
+		    CALL_TRACE) != AllocatorStatusSuccess)		\
+			status = AllocatorStatusFailure;		\
+	}								\
+	name##_CHUNKQ_INIT(queue, queue->cq_allocator);			\
+	return (status);						\
+}									\
+									\
+/* Links an empty chunk, the spare if there is one, after the last. */	\
+static __noinline __unused AllocatorStatusType				\
+name##_CHUNKQ_EXTEND(struct name *queue)				\
+{									\
+	CHUNKQ_CHUNK(name) *chunk = queue->cq_spare;			\
+	AllocatorStatusType status;					\
+	void *memory;							\
+									\
+	if (chunk != NULL)						\
+		queue->cq_spare = NULL;					\
+	else {								\
+		status = INVOKE(queue->cq_allocator, allocate, &memory,	\
+		    sizeof(CHUNKQ_CHUNK(name)) + QUEUE_CACHE_LINE_SIZE - 1,\
+		    CALL_TRACE);					\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+		chunk = (CHUNKQ_CHUNK(name) *)(((uintptr_t)memory +	\
+		    QUEUE_CACHE_LINE_SIZE - 1) &			\
+		    ~(uintptr_t)(QUEUE_CACHE_LINE_SIZE - 1));		\
+		chunk->cc_memory = memory;				\
+	}								\
+	chunk->cc_next = NULL;						\
+	if (queue->cq_last != NULL)					\
+		queue->cq_last->cc_next = chunk;			\
+	else {								\
+		queue->cq_first = chunk;				\
+		queue->cq_head = 0;					\
+	}								\
+	queue->cq_last = chunk;						\
+	queue->cq_tail = 0;						\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+/* Moves past an exhausted first chunk, or rewinds a drained queue. */	\
+static __inline __unused void						\
+name##_CHUNKQ_ADVANCE(struct name *queue)				\
+{									\
+	CHUNKQ_CHUNK(name) *chunk = queue->cq_first;			\
+	void *memory;							\
+									\
+	if (queue->cq_count == 0)					\
+		queue->cq_head = queue->cq_tail = 0;			\
+	else if (queue->cq_head == CHUNKQ_ITEMS(type)) {		\
+		queue->cq_first = chunk->cc_next;			\
+		queue->cq_head = 0;					\
+		if (queue->cq_spare == NULL)				\
+			queue->cq_spare = chunk;			\
+		else {							\
+			memory = chunk->cc_memory;			\
+			INVOKE(queue->cq_allocator, free, &memory,	\
+			    CALL_TRACE);				\
+		}							\
+	}								\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_CHUNKQ_PUSH(struct name *queue, type elm)			\
+{									\
+	AllocatorStatusType status;					\
+									\
+	if (__predict_false(queue->cq_last == NULL ||			\
+	    queue->cq_tail == CHUNKQ_ITEMS(type))) {			\
+		status = name##_CHUNKQ_EXTEND(queue);			\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+	}								\
+	queue->cq_last->cc_items[queue->cq_tail++] = elm;		\
+	queue->cq_count++;						\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused int						\
+name##_CHUNKQ_POP(struct name *queue, type *elmp)			\
+{									\
+	if (queue->cq_count == 0)					\
+		return (0);						\
+	*elmp = queue->cq_first->cc_items[queue->cq_head++];		\
+	queue->cq_count--;						\
+	name##_CHUNKQ_ADVANCE(queue);					\
+	return (1);							\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_CHUNKQ_APPEND(struct name *queue, const type *elms, size_t n)	\
+{									\
+	AllocatorStatusType status;					\
+	size_t run;							\
+									\
+	while (n != 0) {						\
+		if (queue->cq_last == NULL ||				\
+		    queue->cq_tail == CHUNKQ_ITEMS(type)) {		\
+			status = name##_CHUNKQ_EXTEND(queue);		\
+			if (status != AllocatorStatusSuccess)		\
+				return (status);			\
+		}							\
+		run = CHUNKQ_ITEMS(type) - queue->cq_tail;		\
+		if (run > n)						\
+			run = n;					\
+		memcpy(&queue->cq_last->cc_items[queue->cq_tail], elms,	\
+		    run * sizeof(type));				\
+		queue->cq_tail += run;					\
+		queue->cq_count += run;					\
+		elms += run;						\
+		n -= run;						\
+	}								\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused size_t						\
+name##_CHUNKQ_DRAIN(struct name *queue, type *elms, size_t max)		\
+{									\
+	size_t run, drained = 0;					\
+									\
+	while (drained < max && queue->cq_count != 0) {			\
+		run = (queue->cq_first == queue->cq_last ?		\
+		    queue->cq_tail : CHUNKQ_ITEMS(type)) - queue->cq_head;\
+		if (run > max - drained)				\
+			run = max - drained;				\
+		memcpy(&elms[drained],					\
+		    &queue->cq_first->cc_items[queue->cq_head],		\
+		    run * sizeof(type));				\
+		queue->cq_head += run;					\
+		queue->cq_count -= run;					\
+		drained += run;						\
+		name##_CHUNKQ_ADVANCE(queue);				\
+	}								\
+	return (drained);						\
+}
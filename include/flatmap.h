@@ -0,0 +1,381 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "cdefs.h"
+#include "../interfaces/Allocator.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+/*
+ * Open-addressing hash maps with grouped control bytes.
+ *
+ * A flat map stores keys and values inline in one slot array, next to a
+ * parallel array of one-byte control words (see the Swiss table design).
+ * A control byte says whether its slot is empty, deleted, or full, and for
+ * full slots holds seven bits of the key's hash. Lookups hash once, then
+ * compare a whole group of 16 control bytes against those seven bits in a
+ * couple of SSE2 instructions, touching slots only on a likely match. Most
+ * lookups therefore cost one control-byte cache line and one slot.
+ *
+ * Groups are probed triangularly over a power-of-two number of groups, and
+ * the table grows by rehashing into twice as many groups once full and
+ * deleted slots pass 7/8 of capacity. Table memory comes from an Allocator
+ * instance as a single block.
+ *
+ * Functions are emitted per map type by FLATMAP_GENERATE(), which takes a
+ * hash function or macro, hash(key) -> size_t, and an equality function or
+ * macro, eq(key, key) -> int:
+ *
+ *	FLATMAP_HEAD(idmap, uint64_t, struct session *);
+ *	FLATMAP_GENERATE(idmap, uint64_t, struct session *, hashId, EQ_ID)
+ *
+ *	struct idmap map;
+ *	FLATMAP_INIT(idmap, &map, allocator);
+ *	FLATMAP_INSERT(idmap, &map, id, session);
+ *	struct session ** found = FLATMAP_FIND(idmap, &map, id);
+ */
+
+/*
+ * Control bytes. Full slots hold 0..127, so the sign bit alone tells empty
+ * or deleted (free) slots from full ones.
+ */
+#define	FLATMAP_CTRL_EMPTY	((int8_t)-128)
+#define	FLATMAP_CTRL_DELETED	((int8_t)-2)
+#define	FLATMAP_GROUP_SIZE	16
+
+#define	FLATMAP_H1(hash)	((hash) >> 7)
+#define	FLATMAP_H2(hash)	((int8_t)((hash) & 0x7f))
+
+/* Bit i of the result is set when ctrl[i] equals h2. */
+static __inline __unused unsigned
+flatmap_group_match(const int8_t *ctrl, int8_t h2)
+{
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+
+	return ((unsigned)_mm_movemask_epi8(
+	    _mm_cmpeq_epi8(group, _mm_set1_epi8(h2))));
+#else
+	unsigned bits = 0, index;
+
+	for (index = 0; index < FLATMAP_GROUP_SIZE; index++)
+		bits |= (unsigned)(ctrl[index] == h2) << index;
+	return (bits);
+#endif /* __SSE2__ */
+}
+
+/* Bit i of the result is set when ctrl[i] is empty or deleted. */
+static __inline __unused unsigned
+flatmap_group_match_free(const int8_t *ctrl)
+{
+#ifdef __SSE2__
+	return ((unsigned)_mm_movemask_epi8(
+	    _mm_loadu_si128((const __m128i *)ctrl)));
+#else
+	unsigned bits = 0, index;
+
+	for (index = 0; index < FLATMAP_GROUP_SIZE; index++)
+		bits |= (unsigned)(ctrl[index] < 0) << index;
+	return (bits);
+#endif /* __SSE2__ */
+}
+
+static __inline __unused unsigned
+flatmap_group_match_empty(const int8_t *ctrl)
+{
+	return (flatmap_group_match(ctrl, FLATMAP_CTRL_EMPTY));
+}
+
+/* Index of the lowest set bit; bits must be non-zero. */
+static __inline __unused unsigned
+flatmap_first_bit(unsigned bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return ((unsigned)__builtin_ctz(bits));
+#else
+	unsigned index = 0;
+
+	while (!(bits & 1)) {
+		bits >>= 1;
+		index++;
+	}
+	return (index);
+#endif
+}
+
+/*
+ * Flat map declarations.
+ */
+#define	FLATMAP_SLOT(name)	struct name##_flatmap_slot
+
+#define	FLATMAP_HEAD(name, keytype, valuetype)				\
+FLATMAP_SLOT(name) {							\
+	keytype fs_key;							\
+	valuetype fs_value;						\
+};									\
+struct name {								\
+	int8_t *fh_ctrl;		/* groups of control bytes */	\
+	FLATMAP_SLOT(name) *fh_slots;	/* one per control byte */	\
+	size_t fh_groupmask;		/* group count - 1 */		\
+	size_t fh_count;		/* full slots */		\
+	size_t fh_deleted;		/* tombstones */		\
+	Allocator *fh_allocator;	/* source of table memory */	\
+}
+
+/*
+ * Flat map functions.
+ */
+#define	FLATMAP_COUNT(map)	((map)->fh_count)
+#define	FLATMAP_EMPTY(map)	((map)->fh_count == 0)
+#define	FLATMAP_CAPACITY(map)						\
+	((map)->fh_ctrl == NULL ? 0 :					\
+	    ((map)->fh_groupmask + 1) * FLATMAP_GROUP_SIZE)
+
+#define	FLATMAP_INIT(name, map, allocator)				\
+	name##_FLATMAP_INIT((map), (allocator))
+#define	FLATMAP_DESTROY(name, map)	name##_FLATMAP_DESTROY((map))
+#define	FLATMAP_FIND(name, map, key)	name##_FLATMAP_FIND((map), (key))
+#define	FLATMAP_INSERT(name, map, key, value)				\
+	name##_FLATMAP_INSERT((map), (key), (value))
+#define	FLATMAP_REMOVE(name, map, key)	name##_FLATMAP_REMOVE((map), (key))
+#define	FLATMAP_RESERVE(name, map, count)				\
+	name##_FLATMAP_RESERVE((map), (count))
+#define	FLATMAP_NEXT(name, map, slot)	name##_FLATMAP_NEXT((map), (slot))
+
+/* Visits every full slot; the map must not be modified meanwhile. */
+#define	FLATMAP_FOREACH(name, slot, map)				\
+	for ((slot) = FLATMAP_NEXT(name, (map), NULL);			\
+	    (slot);							\
+	    (slot) = FLATMAP_NEXT(name, (map), (slot)))
+
+/*
+ * Emits the map functions for struct name:
+ *
+ *  - _FLATMAP_INIT sets up an empty map; nothing is allocated until the
+ *    first insert. _FLATMAP_DESTROY returns the table to the allocator.
+ *  - _FLATMAP_FIND returns a pointer to the key's value, or NULL.
+ *  - _FLATMAP_INSERT adds or overwrites the key's value, growing the table
+ *    if needed, and returns the allocator's status.
+ *  - _FLATMAP_REMOVE removes the key and returns 1, or 0 if it was absent.
+ *  - _FLATMAP_RESERVE sizes the table for count keys without regrowth.
+ *  - _FLATMAP_NEXT returns the full slot after slot (NULL: the first).
+ */
+#define	FLATMAP_GENERATE(name, keytype, valuetype, hash, eq)		\
+static __inline __unused void						\
+name##_FLATMAP_INIT(struct name *map, Allocator *allocator)		\
+{									\
+	map->fh_ctrl = NULL;						\
+	map->fh_slots = NULL;						\
+	map->fh_groupmask = 0;						\
+	map->fh_count = 0;						\
+	map->fh_deleted = 0;						\
+	map->fh_allocator = allocator;					\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_FLATMAP_DESTROY(struct name *map)				\
+{									\
+	void *memory = map->fh_ctrl;					\
+	AllocatorStatusType status = AllocatorStatusSuccess;		\
+									\
+	if (memory != NULL)						\
+		status = INVOKE(map->fh_allocator, free, &memory,	\
+		    CALL_TRACE);					\
+	name##_FLATMAP_INIT(map, map->fh_allocator);			\
+	return (status);						\
+}									\
+									\
+static __inline __unused valuetype *					\
+name##_FLATMAP_FIND(struct name *map, keytype key)			\
+{									\
+	size_t h = (size_t)(hash(key));					\
+	size_t group, step = 0;						\
+	const int8_t *ctrl;						\
+	unsigned bits;							\
+	FLATMAP_SLOT(name) *slot;					\
+									\
+	if (map->fh_ctrl == NULL)					\
+		return (NULL);						\
+	group = FLATMAP_H1(h) & map->fh_groupmask;			\
+	for (;;) {							\
+		ctrl = &map->fh_ctrl[group * FLATMAP_GROUP_SIZE];	\
+		bits = flatmap_group_match(ctrl, FLATMAP_H2(h));	\
+		while (bits != 0) {					\
+			slot = &map->fh_slots[group * FLATMAP_GROUP_SIZE +\
+			    flatmap_first_bit(bits)];			\
+			if (eq(slot->fs_key, key))			\
+				return (&slot->fs_value);		\
+			bits &= bits - 1;				\
+		}							\
+		/* An empty byte ends every probe through this group. */\
+		if (flatmap_group_match_empty(ctrl) != 0)		\
+			return (NULL);					\
+		group = (group + ++step) & map->fh_groupmask;		\
+	}								\
+}									\
+									\
+/* Places a key known to be absent; the table must have a free slot. */	\
+static __inline __unused FLATMAP_SLOT(name) *				\
+name##_FLATMAP_PLACE(struct name *map, size_t h)			\
+{									\
+	size_t group = FLATMAP_H1(h) & map->fh_groupmask;		\
+	size_t step = 0, index;						\
+	unsigned bits;							\
+									\
+	while ((bits = flatmap_group_match_free(			\
+	    &map->fh_ctrl[group * FLATMAP_GROUP_SIZE])) == 0)		\
+		group = (group + ++step) & map->fh_groupmask;		\
+	index = group * FLATMAP_GROUP_SIZE + flatmap_first_bit(bits);	\
+	if (map->fh_ctrl[index] == FLATMAP_CTRL_DELETED)		\
+		map->fh_deleted--;					\
+	map->fh_ctrl[index] = FLATMAP_H2(h);				\
+	map->fh_count++;						\
+	return (&map->fh_slots[index]);					\
+}									\
+									\
+/* Rehashes into groups groups, dropping tombstones. */		\
+static __noinline __unused AllocatorStatusType				\
+name##_FLATMAP_REHASH(struct name *map, size_t groups)			\
+{									\
+	struct name old = *map;						\
+	size_t capacity = groups * FLATMAP_GROUP_SIZE;			\
+	size_t index;							\
+	void *memory;							\
+	AllocatorStatusType status;					\
+									\
+	/* Control bytes first: slots are aligned by the 16-byte groups. */\
+	status = INVOKE(map->fh_allocator, allocate, &memory,		\
+	    capacity + capacity * sizeof(FLATMAP_SLOT(name)), CALL_TRACE);\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	map->fh_ctrl = (int8_t *)memory;				\
+	map->fh_slots = (FLATMAP_SLOT(name) *)(void *)(map->fh_ctrl + capacity);\
+	map->fh_groupmask = groups - 1;					\
+	map->fh_count = 0;						\
+	map->fh_deleted = 0;						\
+	memset(map->fh_ctrl, FLATMAP_CTRL_EMPTY, capacity);		\
+									\
+	for (index = 0; index < FLATMAP_CAPACITY(&old); index++)	\
+		if (old.fh_ctrl[index] >= 0)				\
+			*name##_FLATMAP_PLACE(map,			\
+			    (size_t)(hash(old.fh_slots[index].fs_key))) =	\
+			    old.fh_slots[index];			\
+	/* The new table is live, so a failed free only leaks the old one. */\
+	if (old.fh_ctrl != NULL) {					\
+		memory = old.fh_ctrl;					\
+		(void)INVOKE(map->fh_allocator, free, &memory,		\
+		    CALL_TRACE);					\
+	}								\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_FLATMAP_RESERVE(struct name *map, size_t count)			\
+{									\
+	size_t groups = 1;						\
+									\
+	while (groups * FLATMAP_GROUP_SIZE * 7 / 8 < count)		\
+		groups *= 2;						\
+	if (groups * FLATMAP_GROUP_SIZE <= FLATMAP_CAPACITY(map))	\
+		return (AllocatorStatusSuccess);			\
+	return (name##_FLATMAP_REHASH(map, groups));			\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_FLATMAP_INSERT(struct name *map, keytype key, valuetype value)	\
+{									\
+	valuetype *found = name##_FLATMAP_FIND(map, key);		\
+	FLATMAP_SLOT(name) *slot;					\
+	AllocatorStatusType status;					\
+	size_t groups;							\
+									\
+	if (found != NULL) {						\
+		*found = value;						\
+		return (AllocatorStatusSuccess);			\
+	}								\
+	if (__predict_false((map->fh_count + map->fh_deleted + 1) * 8 >	\
+	    FLATMAP_CAPACITY(map) * 7)) {				\
+		/* Mostly tombstones: rehash in place rather than grow. */\
+		if (map->fh_ctrl == NULL)				\
+			groups = 1;					\
+		else if (map->fh_deleted >= map->fh_count)		\
+			groups = map->fh_groupmask + 1;			\
+		else							\
+			groups = (map->fh_groupmask + 1) * 2;		\
+		status = name##_FLATMAP_REHASH(map, groups);		\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+	}								\
+	slot = name##_FLATMAP_PLACE(map, (size_t)(hash(key)));		\
+	slot->fs_key = key;						\
+	slot->fs_value = value;						\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused int						\
+name##_FLATMAP_REMOVE(struct name *map, keytype key)			\
+{									\
+	valuetype *found = name##_FLATMAP_FIND(map, key);		\
+	size_t index;							\
+									\
+	if (found == NULL)						\
+		return (0);						\
+	index = (size_t)(container_of(found, FLATMAP_SLOT(name), fs_value)\
+	    - map->fh_slots);						\
+	/* Probes stop at this group anyway if it still has an empty. */\
+	if (flatmap_group_match_empty(&map->fh_ctrl[index &		\
+	    ~(size_t)(FLATMAP_GROUP_SIZE - 1)]) != 0)			\
+		map->fh_ctrl[index] = FLATMAP_CTRL_EMPTY;		\
+	else {								\
+		map->fh_ctrl[index] = FLATMAP_CTRL_DELETED;		\
+		map->fh_deleted++;					\
+	}								\
+	map->fh_count--;						\
+	return (1);							\
+}									\
+									\
+static __inline __unused FLATMAP_SLOT(name) *				\
+name##_FLATMAP_NEXT(struct name *map, FLATMAP_SLOT(name) *slot)		\
+{									\
+	size_t index = slot == NULL ? 0 : (size_t)(slot - map->fh_slots) + 1;\
+									\
+	for (; index < FLATMAP_CAPACITY(map); index++)			\
+		if (map->fh_ctrl[index] >= 0)				\
+			return (&map->fh_slots[index]);			\
+	return (NULL);							\
+}
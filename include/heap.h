@@ -0,0 +1,429 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <string.h>
+#include "queue.h"
+#include "../interfaces/Allocator.h"
+
+/*
+ * This file defines two priority queue structures: pairing heaps and 4-ary
+ * heaps. Both keep the minimum element, as ordered by a cmp function, at the
+ * front; cmp(a, b) returns a negative value if a sorts before b, as for the
+ * RB trees in tree.h.
+ *
+ * A pairing heap is an intrusive multiway tree headed by a pointer to its
+ * root. Each element holds pointers to its first child, its next sibling and
+ * its previous sibling (or parent, for a first child). Insertion and melding
+ * two heaps are O(1), as is reading the minimum; removing the minimum pairs
+ * up the root's children in two passes, which is amortised O(log n) (see
+ * Fredman, Sedgewick, Sleator and Tarjan, "The Pairing Heap: A New Form of
+ * Self-Adjusting Heap"). Any element may be removed, and an element whose
+ * key has decreased may be moved up, without searching for it.
+ *
+ * A 4-ary heap keeps elements by value in an array obtained from an
+ * Allocator instance, doubling it as needed. The four children of a node are
+ * adjacent, so a sift down compares within one or two cache lines per level,
+ * and the tree is half as deep as a binary heap. It is the better choice for
+ * small elements, such as a deadline and a pointer, that are only ever
+ * pushed and popped.
+ *
+ *	struct job {
+ *		PHEAP_ENTRY(job) link;
+ *		uint64_t deadline;
+ *	};
+ *	PHEAP_HEAD(jobheap, job);
+ *	PHEAP_GENERATE(jobheap, job, link, jobcmp)
+ *
+ *	struct jobheap heap = PHEAP_HEAD_INITIALIZER(heap);
+ *	PHEAP_INSERT(jobheap, &heap, job);
+ *	job = PHEAP_REMOVE_MIN(jobheap, &heap);
+ *
+ *	DHEAP_HEAD(deadlines, struct deadline);
+ *	DHEAP_GENERATE(deadlines, struct deadline, deadlinecmp)
+ *
+ *	DHEAP_INIT(deadlines, &heap, allocator, 64);
+ *	DHEAP_PUSH(deadlines, &heap, &deadline);
+ *	DHEAP_POP(deadlines, &heap, &deadline);
+ */
+
+/*
+ * Pairing heap declarations.
+ */
+#define	PHEAP_HEAD(name, type)						\
+struct name {								\
+	struct type *phh_root;		/* minimum element */		\
+}
+
+#define	PHEAP_HEAD_INITIALIZER(head)					\
+	{ NULL }
+
+#define	PHEAP_ENTRY(type)						\
+struct {								\
+	struct type *phe_child;		/* first child */		\
+	struct type *phe_next;		/* next sibling */		\
+	struct type *phe_prev;		/* prev sibling, or parent */	\
+}
+
+/*
+ * Pairing heap functions.
+ */
+#define	PHEAP_INIT(head) MULTI_LINE_MACRO_BEGIN				\
+	(head)->phh_root = NULL;					\
+MULTI_LINE_MACRO_END
+
+#define	PHEAP_EMPTY(head)	((head)->phh_root == NULL)
+#define	PHEAP_FIRST(head)	((head)->phh_root)
+
+#define	PHEAP_INSERT(name, head, elm)	name##_PHEAP_INSERT((head), (elm))
+#define	PHEAP_REMOVE_MIN(name, head)	name##_PHEAP_REMOVE_MIN((head))
+#define	PHEAP_REMOVE(name, head, elm)	name##_PHEAP_REMOVE((head), (elm))
+#define	PHEAP_DECREASE(name, head, elm)	name##_PHEAP_DECREASE((head), (elm))
+#define	PHEAP_MELD(name, head1, head2)					\
+	name##_PHEAP_MELD((head1), (head2))
+
+/*
+ * Emits the pairing heap functions for struct name over struct type
+ * elements linked through field:
+ *
+ *  - _PHEAP_INSERT adds elm.
+ *  - _PHEAP_REMOVE_MIN removes and returns the minimum, or NULL if empty.
+ *  - _PHEAP_REMOVE removes elm, which must be in the heap, and returns it.
+ *  - _PHEAP_DECREASE restores order after elm's key has decreased.
+ *  - _PHEAP_MELD moves every element of head2 into head1.
+ */
+#define	PHEAP_PROTOTYPE(name, type, field, cmp)				\
+	PHEAP_PROTOTYPE_INTERNAL(name, type, field, cmp,)
+#define	PHEAP_PROTOTYPE_STATIC(name, type, field, cmp)			\
+	PHEAP_PROTOTYPE_INTERNAL(name, type, field, cmp, __unused static)
+#define	PHEAP_PROTOTYPE_INTERNAL(name, type, field, cmp, attr)		\
+attr struct type *name##_PHEAP_LINK(struct type *, struct type *);	\
+attr struct type *name##_PHEAP_MERGE_PAIRS(struct type *);		\
+attr void name##_PHEAP_INSERT(struct name *, struct type *);		\
+attr struct type *name##_PHEAP_REMOVE_MIN(struct name *);		\
+attr struct type *name##_PHEAP_REMOVE(struct name *, struct type *);	\
+attr void name##_PHEAP_DECREASE(struct name *, struct type *);		\
+attr void name##_PHEAP_MELD(struct name *, struct name *);
+
+#define	PHEAP_GENERATE(name, type, field, cmp)				\
+	PHEAP_GENERATE_INTERNAL(name, type, field, cmp,)
+#define	PHEAP_GENERATE_STATIC(name, type, field, cmp)			\
+	PHEAP_GENERATE_INTERNAL(name, type, field, cmp, __unused static)
+#define	PHEAP_GENERATE_INTERNAL(name, type, field, cmp, attr)		\
+/* Makes the greater of two roots the first child of the lesser. */	\
+attr struct type *							\
+name##_PHEAP_LINK(struct type *a, struct type *b)			\
+{									\
+	struct type *tmp;						\
+									\
+	if ((cmp)(b, a) < 0) {						\
+		tmp = a;						\
+		a = b;							\
+		b = tmp;						\
+	}								\
+	b->field.phe_prev = a;						\
+	b->field.phe_next = a->field.phe_child;				\
+	if (a->field.phe_child != NULL)					\
+		a->field.phe_child->field.phe_prev = b;			\
+	a->field.phe_child = b;						\
+	a->field.phe_next = a->field.phe_prev = NULL;			\
+	return (a);							\
+}									\
+									\
+/* Melds a sibling list into one tree: pairs left to right, then folds	\
+ * the pairs right to left. */						\
+attr struct type *							\
+name##_PHEAP_MERGE_PAIRS(struct type *first)				\
+{									\
+	struct type *a, *b, *pairs = NULL;				\
+									\
+	while ((a = first) != NULL) {					\
+		if ((b = a->field.phe_next) == NULL) {			\
+			a->field.phe_next = pairs;			\
+			pairs = a;					\
+			break;						\
+		}							\
+		first = b->field.phe_next;				\
+		a = name##_PHEAP_LINK(a, b);				\
+		a->field.phe_next = pairs;				\
+		pairs = a;						\
+	}								\
+	a = pairs;							\
+	pairs = pairs->field.phe_next;					\
+	a->field.phe_next = a->field.phe_prev = NULL;			\
+	while ((b = pairs) != NULL) {					\
+		pairs = b->field.phe_next;				\
+		a = name##_PHEAP_LINK(b, a);				\
+	}								\
+	return (a);							\
+}									\
+									\
+attr void								\
+name##_PHEAP_INSERT(struct name *head, struct type *elm)		\
+{									\
+	elm->field.phe_child = NULL;					\
+	elm->field.phe_next = elm->field.phe_prev = NULL;		\
+	if (head->phh_root == NULL)					\
+		head->phh_root = elm;					\
+	else								\
+		head->phh_root = name##_PHEAP_LINK(head->phh_root, elm);\
+}									\
+									\
+attr struct type *							\
+name##_PHEAP_REMOVE_MIN(struct name *head)				\
+{									\
+	struct type *root = head->phh_root;				\
+									\
+	if (root == NULL)						\
+		return (NULL);						\
+	if (root->field.phe_child != NULL)				\
+		head->phh_root =					\
+		    name##_PHEAP_MERGE_PAIRS(root->field.phe_child);	\
+	else								\
+		head->phh_root = NULL;					\
+	root->field.phe_child = NULL;					\
+	return (root);							\
+}									\
+									\
+/* Unlinks a non-root element, with its subtree, from its siblings. */	\
+static __inline __unused void						\
+name##_PHEAP_DETACH(struct type *elm)					\
+{									\
+	struct type *prev = elm->field.phe_prev;			\
+									\
+	if (prev->field.phe_child == elm)				\
+		prev->field.phe_child = elm->field.phe_next;		\
+	else								\
+		prev->field.phe_next = elm->field.phe_next;		\
+	if (elm->field.phe_next != NULL)				\
+		elm->field.phe_next->field.phe_prev = prev;		\
+	elm->field.phe_next = elm->field.phe_prev = NULL;		\
+}									\
+									\
+attr struct type *							\
+name##_PHEAP_REMOVE(struct name *head, struct type *elm)		\
+{									\
+	struct type *children;						\
+									\
+	if (elm == head->phh_root)					\
+		return (name##_PHEAP_REMOVE_MIN(head));			\
+	name##_PHEAP_DETACH(elm);					\
+	if ((children = elm->field.phe_child) != NULL) {		\
+		elm->field.phe_child = NULL;				\
+		head->phh_root = name##_PHEAP_LINK(head->phh_root,	\
+		    name##_PHEAP_MERGE_PAIRS(children));		\
+	}								\
+	return (elm);							\
+}									\
+									\
+attr void								\
+name##_PHEAP_DECREASE(struct name *head, struct type *elm)		\
+{									\
+	if (elm == head->phh_root)					\
+		return;							\
+	name##_PHEAP_DETACH(elm);					\
+	head->phh_root = name##_PHEAP_LINK(head->phh_root, elm);	\
+}									\
+									\
+attr void								\
+name##_PHEAP_MELD(struct name *head1, struct name *head2)		\
+{									\
+	if (head2->phh_root == NULL)					\
+		return;							\
+	if (head1->phh_root == NULL)					\
+		head1->phh_root = head2->phh_root;			\
+	else								\
+		head1->phh_root = name##_PHEAP_LINK(head1->phh_root,	\
+		    head2->phh_root);					\
+	head2->phh_root = NULL;						\
+}
+
+/*
+ * 4-ary heap declarations.
+ */
+#define	DHEAP_ARITY	4
+
+#define	DHEAP_HEAD(name, type)						\
+struct name {								\
+	type *dh_items;			/* heap-ordered array */	\
+	size_t dh_count;		/* elements in use */		\
+	size_t dh_capacity;		/* elements allocated */	\
+	Allocator *dh_allocator;	/* source of the array */	\
+}
+
+/*
+ * 4-ary heap functions.
+ */
+#define	DHEAP_COUNT(heap)	((heap)->dh_count)
+#define	DHEAP_EMPTY(heap)	((heap)->dh_count == 0)
+#define	DHEAP_FIRST(heap)						\
+	((heap)->dh_count != 0 ? &(heap)->dh_items[0] : NULL)
+
+#define	DHEAP_INIT(name, heap, allocator, capacity)			\
+	name##_DHEAP_INIT((heap), (allocator), (capacity))
+#define	DHEAP_DESTROY(name, heap)	name##_DHEAP_DESTROY((heap))
+#define	DHEAP_RESERVE(name, heap, capacity)				\
+	name##_DHEAP_RESERVE((heap), (capacity))
+#define	DHEAP_PUSH(name, heap, elmp)	name##_DHEAP_PUSH((heap), (elmp))
+#define	DHEAP_POP(name, heap, elmp)	name##_DHEAP_POP((heap), (elmp))
+
+/*
+ * Emits the heap functions for struct name holding elements of type, where
+ * cmp takes two const type pointers:
+ *
+ *  - _DHEAP_INIT allocates room for capacity elements, which may be 0.
+ *    _DHEAP_DESTROY frees the array. Both return the allocator's status.
+ *  - _DHEAP_RESERVE grows the array to hold at least capacity elements.
+ *  - _DHEAP_PUSH copies *elmp in, growing the array if needed, and returns
+ *    the allocator's status.
+ *  - _DHEAP_POP copies the minimum out to *elmp and removes it, returning
+ *    1, or returns 0 if the heap is empty.
+ */
+#define	DHEAP_GENERATE(name, type, cmp)					\
+static __inline __unused AllocatorStatusType				\
+name##_DHEAP_INIT(struct name *heap, Allocator *allocator,		\
+    size_t capacity)							\
+{									\
+	void *memory = NULL;						\
+	AllocatorStatusType status;					\
+									\
+	heap->dh_allocator = allocator;					\
+	heap->dh_items = NULL;						\
+	heap->dh_count = heap->dh_capacity = 0;				\
+	if (capacity == 0)						\
+		return (AllocatorStatusSuccess);			\
+	status = INVOKE(allocator, allocate, &memory,			\
+	    capacity * sizeof(type), CALL_TRACE);			\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	heap->dh_items = (type *)memory;				\
+	heap->dh_capacity = capacity;					\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_DHEAP_DESTROY(struct name *heap)					\
+{									\
+	void *memory = heap->dh_items;					\
+	AllocatorStatusType status = AllocatorStatusSuccess;		\
+									\
+	if (memory != NULL)						\
+		status = INVOKE(heap->dh_allocator, free, &memory,	\
+		    CALL_TRACE);					\
+	heap->dh_items = NULL;						\
+	heap->dh_count = heap->dh_capacity = 0;				\
+	return (status);						\
+}									\
+									\
+static __noinline __unused AllocatorStatusType				\
+name##_DHEAP_RESERVE(struct name *heap, size_t capacity)		\
+{									\
+	void *memory, *old = heap->dh_items;				\
+	AllocatorStatusType status;					\
+									\
+	if (capacity <= heap->dh_capacity)				\
+		return (AllocatorStatusSuccess);			\
+	status = INVOKE(heap->dh_allocator, allocate, &memory,		\
+	    capacity * sizeof(type), CALL_TRACE);			\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	/* The items have moved, so a failed free only leaks the old array. */\
+	if (old != NULL) {						\
+		memcpy(memory, old, heap->dh_count * sizeof(type));	\
+		(void)INVOKE(heap->dh_allocator, free, &old, CALL_TRACE);\
+	}								\
+	heap->dh_items = (type *)memory;				\
+	heap->dh_capacity = capacity;					\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_DHEAP_PUSH(struct name *heap, const type *elmp)			\
+{									\
+	type *items;							\
+	size_t index, parent;						\
+	AllocatorStatusType status;					\
+									\
+	if (__predict_false(heap->dh_count == heap->dh_capacity)) {	\
+		status = name##_DHEAP_RESERVE(heap, heap->dh_capacity != 0 ?\
+		    heap->dh_capacity * 2 : 16);			\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+	}								\
+	/* Move the hole up until elm no longer sorts before its parent. */\
+	items = heap->dh_items;						\
+	index = heap->dh_count++;					\
+	while (index > 0) {						\
+		parent = (index - 1) / DHEAP_ARITY;			\
+		if ((cmp)(elmp, &items[parent]) >= 0)			\
+			break;						\
+		items[index] = items[parent];				\
+		index = parent;						\
+	}								\
+	items[index] = *elmp;						\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused int						\
+name##_DHEAP_POP(struct name *heap, type *elmp)				\
+{									\
+	type *items = heap->dh_items;					\
+	size_t count, index, child, best, last;				\
+									\
+	if (heap->dh_count == 0)					\
+		return (0);						\
+	*elmp = items[0];						\
+	count = --heap->dh_count;					\
+	if (count == 0)							\
+		return (1);						\
+	/* Move the hole down from the root, then drop the last element	\
+	 * into it. */							\
+	index = 0;							\
+	for (;;) {							\
+		child = index * DHEAP_ARITY + 1;			\
+		if (child >= count)					\
+			break;						\
+		best = child;						\
+		last = child + DHEAP_ARITY < count ?			\
+		    child + DHEAP_ARITY : count;			\
+		for (child++; child < last; child++)			\
+			if ((cmp)(&items[child], &items[best]) < 0)	\
+				best = child;				\
+		if ((cmp)(&items[count], &items[best]) <= 0)		\
+			break;						\
+		items[index] = items[best];				\
+		index = best;						\
+	}								\
+	items[index] = items[count];					\
+	return (1);							\
+}
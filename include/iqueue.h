@@ -0,0 +1,299 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+
+/*
+ * This file defines index-linked variants of singly-linked lists and tail
+ * queues, ISLIST and ITAILQ, for elements allocated from one array.
+ *
+ * Links are 32-bit indices into the array, the base, rather than pointers:
+ * a singly-linked entry is 4 bytes instead of 8 and a tail queue entry 8
+ * instead of 16, which matters for pools of hundreds of millions of nodes.
+ * Since heads and entries hold no addresses, a list inside a file or shared
+ * memory mapping stays valid wherever the region is mapped; keep the heads
+ * in the region too. Index 0 means no element and index i names base[i -
+ * 1], so zeroed memory holds empty heads and unlinked entries.
+ *
+ * Every operation that follows or forms a link takes the base, which must
+ * be a pointer to the element type. Otherwise the macros behave as their
+ * pointer-linked counterparts in queue.h, except that ITAILQ heads store the
+ * last element rather than a pointer to its link, so reverse traversal
+ * needs no head type and ITAILQ_REMOVE needs the head:
+ *
+ *	struct node {
+ *		ITAILQ_ENTRY(node) link;
+ *		...
+ *	};
+ *	ITAILQ_HEAD(nodelist, node);
+ *
+ *	struct node *pool = mmap(...);
+ *	struct nodelist *lru = (struct nodelist *)(pool + npool);
+ *	ITAILQ_INSERT_TAIL(lru, pool, &pool[42], link);
+ *	ITAILQ_FOREACH(node, lru, pool, link) { ... }
+ *
+ *				ISLIST	ITAILQ
+ * _HEAD			+	+
+ * _HEAD_INITIALIZER		+	+
+ * _ENTRY			+	+
+ * _INIT			+	+
+ * _EMPTY			+	+
+ * _FIRST			+	+
+ * _LAST			-	+
+ * _NEXT			+	+
+ * _PREV			-	+
+ * _FOREACH			+	+
+ * _FOREACH_SAFE		+	+
+ * _FOREACH_REVERSE		-	+
+ * _INSERT_HEAD			+	+
+ * _INSERT_BEFORE		-	+
+ * _INSERT_AFTER		+	+
+ * _INSERT_TAIL			-	+
+ * _CONCAT			-	+
+ * _REMOVE_AFTER		+	-
+ * _REMOVE_HEAD			+	-
+ * _REMOVE			+	+
+ */
+#define	IQUEUE_NONE	0
+
+/* The element an index names, or NULL; the index of elm, or IQUEUE_NONE. */
+#define	IQUEUE_ELEMENT(base, index)					\
+	((index) == IQUEUE_NONE ? NULL : &(base)[(index) - 1])
+#define	IQUEUE_INDEX(base, elm)						\
+	((elm) == NULL ? IQUEUE_NONE : (uint32_t)((elm) - (base)) + 1)
+
+/*
+ * Index-linked singly-linked list declarations.
+ */
+#define	ISLIST_HEAD(name, type)						\
+struct name {								\
+	uint32_t islh_first;	/* first element */			\
+}
+
+#define	ISLIST_HEAD_INITIALIZER(head)					\
+	{ IQUEUE_NONE }
+
+#define	ISLIST_ENTRY(type)						\
+struct {								\
+	uint32_t isle_next;	/* next element */			\
+}
+
+/*
+ * Index-linked singly-linked list functions.
+ */
+#define	ISLIST_EMPTY(head)	((head)->islh_first == IQUEUE_NONE)
+
+#define	ISLIST_FIRST(head, base)					\
+	IQUEUE_ELEMENT((base), (head)->islh_first)
+
+#define	ISLIST_NEXT(base, elm, field)					\
+	IQUEUE_ELEMENT((base), (elm)->field.isle_next)
+
+#define	ISLIST_FOREACH(var, head, base, field)				\
+	for ((var) = ISLIST_FIRST((head), (base));			\
+	    (var);							\
+	    (var) = ISLIST_NEXT((base), (var), field))
+
+#define	ISLIST_FOREACH_SAFE(var, head, base, field, tvar)		\
+	for ((var) = ISLIST_FIRST((head), (base));			\
+	    (var) && ((tvar) = ISLIST_NEXT((base), (var), field), 1);	\
+	    (var) = (tvar))
+
+#define	ISLIST_INIT(head) MULTI_LINE_MACRO_BEGIN			\
+	(head)->islh_first = IQUEUE_NONE;				\
+MULTI_LINE_MACRO_END
+
+#define	ISLIST_INSERT_AFTER(base, slistelm, elm, field) MULTI_LINE_MACRO_BEGIN\
+	(elm)->field.isle_next = (slistelm)->field.isle_next;		\
+	(slistelm)->field.isle_next = IQUEUE_INDEX((base), (elm));	\
+MULTI_LINE_MACRO_END
+
+#define	ISLIST_INSERT_HEAD(head, base, elm, field) MULTI_LINE_MACRO_BEGIN\
+	(elm)->field.isle_next = (head)->islh_first;			\
+	(head)->islh_first = IQUEUE_INDEX((base), (elm));		\
+MULTI_LINE_MACRO_END
+
+#define	ISLIST_REMOVE_AFTER(base, elm, field) MULTI_LINE_MACRO_BEGIN	\
+	(elm)->field.isle_next =					\
+	    ISLIST_NEXT((base), (elm), field)->field.isle_next;		\
+MULTI_LINE_MACRO_END
+
+#define	ISLIST_REMOVE_HEAD(head, base, field) MULTI_LINE_MACRO_BEGIN	\
+	(head)->islh_first =						\
+	    ISLIST_FIRST((head), (base))->field.isle_next;		\
+MULTI_LINE_MACRO_END
+
+#define	ISLIST_REMOVE(head, base, elm, type, field) MULTI_LINE_MACRO_BEGIN\
+	uint32_t islist_index = IQUEUE_INDEX((base), (elm));		\
+	if ((head)->islh_first == islist_index) {			\
+		ISLIST_REMOVE_HEAD((head), (base), field);		\
+	}								\
+	else {								\
+		QUEUE_TYPEOF(type) *curelm = ISLIST_FIRST((head), (base));\
+		while (curelm->field.isle_next != islist_index)		\
+			curelm = ISLIST_NEXT((base), curelm, field);	\
+		ISLIST_REMOVE_AFTER((base), curelm, field);		\
+	}								\
+MULTI_LINE_MACRO_END
+
+/*
+ * Index-linked tail queue declarations.
+ */
+#define	ITAILQ_HEAD(name, type)						\
+struct name {								\
+	uint32_t itqh_first;	/* first element */			\
+	uint32_t itqh_last;	/* last element */			\
+}
+
+#define	ITAILQ_HEAD_INITIALIZER(head)					\
+	{ IQUEUE_NONE, IQUEUE_NONE }
+
+#define	ITAILQ_ENTRY(type)						\
+struct {								\
+	uint32_t itqe_next;	/* next element */			\
+	uint32_t itqe_prev;	/* previous element */			\
+}
+
+/*
+ * Index-linked tail queue functions.
+ */
+#define	ITAILQ_EMPTY(head)	((head)->itqh_first == IQUEUE_NONE)
+
+#define	ITAILQ_FIRST(head, base)					\
+	IQUEUE_ELEMENT((base), (head)->itqh_first)
+
+#define	ITAILQ_LAST(head, base)						\
+	IQUEUE_ELEMENT((base), (head)->itqh_last)
+
+#define	ITAILQ_NEXT(base, elm, field)					\
+	IQUEUE_ELEMENT((base), (elm)->field.itqe_next)
+
+#define	ITAILQ_PREV(base, elm, field)					\
+	IQUEUE_ELEMENT((base), (elm)->field.itqe_prev)
+
+#define	ITAILQ_FOREACH(var, head, base, field)				\
+	for ((var) = ITAILQ_FIRST((head), (base));			\
+	    (var);							\
+	    (var) = ITAILQ_NEXT((base), (var), field))
+
+#define	ITAILQ_FOREACH_SAFE(var, head, base, field, tvar)		\
+	for ((var) = ITAILQ_FIRST((head), (base));			\
+	    (var) && ((tvar) = ITAILQ_NEXT((base), (var), field), 1);	\
+	    (var) = (tvar))
+
+#define	ITAILQ_FOREACH_REVERSE(var, head, base, field)			\
+	for ((var) = ITAILQ_LAST((head), (base));			\
+	    (var);							\
+	    (var) = ITAILQ_PREV((base), (var), field))
+
+#define	ITAILQ_INIT(head) MULTI_LINE_MACRO_BEGIN			\
+	(head)->itqh_first = IQUEUE_NONE;				\
+	(head)->itqh_last = IQUEUE_NONE;				\
+MULTI_LINE_MACRO_END
+
+#define	ITAILQ_INSERT_HEAD(head, base, elm, field) MULTI_LINE_MACRO_BEGIN\
+	uint32_t itailq_index = IQUEUE_INDEX((base), (elm));		\
+	(elm)->field.itqe_next = (head)->itqh_first;			\
+	(elm)->field.itqe_prev = IQUEUE_NONE;				\
+	if ((head)->itqh_first != IQUEUE_NONE)				\
+		ITAILQ_FIRST((head), (base))->field.itqe_prev =		\
+		    itailq_index;					\
+	else								\
+		(head)->itqh_last = itailq_index;			\
+	(head)->itqh_first = itailq_index;				\
+MULTI_LINE_MACRO_END
+
+#define	ITAILQ_INSERT_TAIL(head, base, elm, field) MULTI_LINE_MACRO_BEGIN\
+	uint32_t itailq_index = IQUEUE_INDEX((base), (elm));		\
+	(elm)->field.itqe_next = IQUEUE_NONE;				\
+	(elm)->field.itqe_prev = (head)->itqh_last;			\
+	if ((head)->itqh_last != IQUEUE_NONE)				\
+		ITAILQ_LAST((head), (base))->field.itqe_next =		\
+		    itailq_index;					\
+	else								\
+		(head)->itqh_first = itailq_index;			\
+	(head)->itqh_last = itailq_index;				\
+MULTI_LINE_MACRO_END
+
+#define	ITAILQ_INSERT_AFTER(head, base, listelm, elm, field) MULTI_LINE_MACRO_BEGIN\
+	uint32_t itailq_index = IQUEUE_INDEX((base), (elm));		\
+	(elm)->field.itqe_next = (listelm)->field.itqe_next;		\
+	(elm)->field.itqe_prev = IQUEUE_INDEX((base), (listelm));	\
+	if ((elm)->field.itqe_next != IQUEUE_NONE)			\
+		ITAILQ_NEXT((base), (elm), field)->field.itqe_prev =	\
+		    itailq_index;					\
+	else								\
+		(head)->itqh_last = itailq_index;			\
+	(listelm)->field.itqe_next = itailq_index;			\
+MULTI_LINE_MACRO_END
+
+#define	ITAILQ_INSERT_BEFORE(head, base, listelm, elm, field) MULTI_LINE_MACRO_BEGIN\
+	uint32_t itailq_index = IQUEUE_INDEX((base), (elm));		\
+	(elm)->field.itqe_prev = (listelm)->field.itqe_prev;		\
+	(elm)->field.itqe_next = IQUEUE_INDEX((base), (listelm));	\
+	if ((elm)->field.itqe_prev != IQUEUE_NONE)			\
+		ITAILQ_PREV((base), (elm), field)->field.itqe_next =	\
+		    itailq_index;					\
+	else								\
+		(head)->itqh_first = itailq_index;			\
+	(listelm)->field.itqe_prev = itailq_index;			\
+MULTI_LINE_MACRO_END
+
+#define	ITAILQ_REMOVE(head, base, elm, field) MULTI_LINE_MACRO_BEGIN	\
+	if ((elm)->field.itqe_next != IQUEUE_NONE)			\
+		ITAILQ_NEXT((base), (elm), field)->field.itqe_prev =	\
+		    (elm)->field.itqe_prev;				\
+	else								\
+		(head)->itqh_last = (elm)->field.itqe_prev;		\
+	if ((elm)->field.itqe_prev != IQUEUE_NONE)			\
+		ITAILQ_PREV((base), (elm), field)->field.itqe_next =	\
+		    (elm)->field.itqe_next;				\
+	else								\
+		(head)->itqh_first = (elm)->field.itqe_next;		\
+MULTI_LINE_MACRO_END
+
+#define	ITAILQ_CONCAT(head1, head2, base, field) MULTI_LINE_MACRO_BEGIN	\
+	if (!ITAILQ_EMPTY((head2))) {					\
+		if (!ITAILQ_EMPTY((head1))) {				\
+			ITAILQ_LAST((head1), (base))->field.itqe_next =	\
+			    (head2)->itqh_first;			\
+			ITAILQ_FIRST((head2), (base))->field.itqe_prev =\
+			    (head1)->itqh_last;				\
+		} else							\
+			(head1)->itqh_first = (head2)->itqh_first;	\
+		(head1)->itqh_last = (head2)->itqh_last;		\
+		ITAILQ_INIT((head2));					\
+	}								\
+MULTI_LINE_MACRO_END
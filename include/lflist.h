@@ -0,0 +1,271 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+
+/*
+ * This file defines lock-free sorted lists (see Harris, "A Pragmatic
+ * Implementation of Non-Blocking Linked-Lists", and Michael, "High
+ * Performance Dynamic Lock-Free Hash Tables and List-Based Sets").
+ *
+ * A lock-free list is singly-linked, like an SLIST, and kept in ascending
+ * order by a cmp function, which returns a negative value if a sorts before
+ * b, as for the RB trees in tree.h. Keys are unique. Any number of threads
+ * may insert, remove and look up elements concurrently; each operation is a
+ * search followed by a single compare-and-swap, retried only when another
+ * thread changed the same link.
+ *
+ * Removal is two steps. The remover first marks the element by setting the
+ * low bit of its own next pointer, which removes it logically and stops any
+ * insertion after it; it is then unlinked by a compare-and-swap on its
+ * predecessor, by the remover or by any later search passing it. Elements
+ * must therefore be at least 2-byte aligned. The LFLIST_MARK() family of
+ * macros manipulates such tagged pointers, and may be used for other
+ * lock-free structures.
+ *
+ * Searches read elements that another thread may be removing, so a removed
+ * element may only be freed once no thread can still be traversing it. Run
+ * list operations as RCU readers and hand removed elements to RCU_DEFER()
+ * (see rcu.h); once _LFLIST_REMOVE returns, the element is unreachable from
+ * the head. Lookups and iteration never write to the list.
+ *
+ *	struct member {
+ *		LFLIST_ENTRY(member) link;
+ *		uint64_t id;
+ *		struct rcu_callback free;
+ *	};
+ *	LFLIST_HEAD(memberset, member);
+ *	LFLIST_GENERATE(memberset, member, link, membercmp)
+ *
+ *	struct memberset set = LFLIST_HEAD_INITIALIZER(set);
+ *	if (LFLIST_INSERT(memberset, &set, member) != NULL)
+ *		...	// already present
+ *	if ((member = LFLIST_REMOVE(memberset, &set, &key)) != NULL)
+ *		RCU_DEFER(&domain, &member->free, freeMember);
+ *	LFLIST_FOREACH(member, memberset, &set) { ... }
+ */
+
+/*
+ * Tagged pointers.
+ */
+#define	LFLIST_MARK_BIT		((uintptr_t)1)
+#define	LFLIST_IS_MARKED(ptr)	(((uintptr_t)(ptr) & LFLIST_MARK_BIT) != 0)
+#define	LFLIST_MARK(type, ptr)						\
+	((QUEUE_TYPEOF(type) *)((uintptr_t)(ptr) | LFLIST_MARK_BIT))
+#define	LFLIST_UNMARK(type, ptr)					\
+	((QUEUE_TYPEOF(type) *)((uintptr_t)(ptr) & ~LFLIST_MARK_BIT))
+
+/*
+ * Lock-free list declarations.
+ */
+#define	LFLIST_HEAD(name, type)						\
+struct name {								\
+	struct type *lfh_first;		/* first element */		\
+}
+
+#define	LFLIST_HEAD_INITIALIZER(head)					\
+	{ NULL }
+
+#define	LFLIST_ENTRY(type)						\
+struct {								\
+	struct type *lfe_next;		/* next element, maybe marked */\
+}
+
+/*
+ * Lock-free list functions.
+ */
+#define	LFLIST_INIT(head) MULTI_LINE_MACRO_BEGIN			\
+	QUEUE_ATOMIC_STORE(&(head)->lfh_first, NULL, RELEASE);		\
+MULTI_LINE_MACRO_END
+
+#define	LFLIST_EMPTY(head)						\
+	(QUEUE_ATOMIC_LOAD(&(head)->lfh_first, ACQUIRE) == NULL)
+
+#define	LFLIST_FIRST(name, head)	name##_LFLIST_FIRST((head))
+#define	LFLIST_NEXT(name, elm)		name##_LFLIST_NEXT((elm))
+#define	LFLIST_INSERT(name, head, elm)	name##_LFLIST_INSERT((head), (elm))
+#define	LFLIST_REMOVE(name, head, elm)	name##_LFLIST_REMOVE((head), (elm))
+#define	LFLIST_FIND(name, head, elm)	name##_LFLIST_FIND((head), (elm))
+
+/* Visits the elements present throughout, in order; others may be missed. */
+#define	LFLIST_FOREACH(var, name, head)					\
+	for ((var) = LFLIST_FIRST(name, (head));			\
+	    (var) != NULL;						\
+	    (var) = LFLIST_NEXT(name, (var)))
+
+/*
+ * Emits the lock-free list functions for struct name over struct type
+ * elements linked through field:
+ *
+ *  - _LFLIST_SEARCH returns the first unmarked element not before elm, or
+ *    NULL, and sets *prevp to the link that pointed at it. It unlinks the
+ *    marked elements it passes.
+ *  - _LFLIST_INSERT adds elm and returns NULL, or returns the element
+ *    comparing equal to elm if there is one.
+ *  - _LFLIST_REMOVE removes and returns the element comparing equal to elm,
+ *    or returns NULL. Exactly one of several racing removers gets it.
+ *  - _LFLIST_FIND returns the element comparing equal to elm, or NULL.
+ *  - _LFLIST_FIRST and _LFLIST_NEXT step over unmarked elements.
+ */
+#define	LFLIST_PROTOTYPE(name, type, field, cmp)			\
+	LFLIST_PROTOTYPE_INTERNAL(name, type, field, cmp,)
+#define	LFLIST_PROTOTYPE_STATIC(name, type, field, cmp)			\
+	LFLIST_PROTOTYPE_INTERNAL(name, type, field, cmp, __unused static)
+#define	LFLIST_PROTOTYPE_INTERNAL(name, type, field, cmp, attr)		\
+attr struct type *name##_LFLIST_SEARCH(struct name *, struct type *,	\
+    struct type ***);							\
+attr struct type *name##_LFLIST_INSERT(struct name *, struct type *);	\
+attr struct type *name##_LFLIST_REMOVE(struct name *, struct type *);	\
+attr struct type *name##_LFLIST_FIND(struct name *, struct type *);	\
+attr struct type *name##_LFLIST_FIRST(struct name *);			\
+attr struct type *name##_LFLIST_NEXT(struct type *);
+
+#define	LFLIST_GENERATE(name, type, field, cmp)				\
+	LFLIST_GENERATE_INTERNAL(name, type, field, cmp,)
+#define	LFLIST_GENERATE_STATIC(name, type, field, cmp)			\
+	LFLIST_GENERATE_INTERNAL(name, type, field, cmp, __unused static)
+#define	LFLIST_GENERATE_INTERNAL(name, type, field, cmp, attr)		\
+attr struct type *							\
+name##_LFLIST_SEARCH(struct name *head, struct type *elm,		\
+    struct type ***prevp)						\
+{									\
+	struct type **prev, *curr, *next;				\
+									\
+retry:									\
+	prev = &head->lfh_first;					\
+	curr = QUEUE_ATOMIC_LOAD(prev, ACQUIRE);			\
+	while (curr != NULL) {						\
+		next = QUEUE_ATOMIC_LOAD(&curr->field.lfe_next, ACQUIRE);\
+		if (LFLIST_IS_MARKED(next)) {				\
+			/* Unlink it; prev was removed if this fails. */\
+			next = LFLIST_UNMARK(type, next);		\
+			if (!QUEUE_ATOMIC_CAS(prev, &curr, next,	\
+			    ACQ_REL, ACQUIRE))				\
+				goto retry;				\
+			curr = next;					\
+			continue;					\
+		}							\
+		if ((cmp)(curr, elm) >= 0)				\
+			break;						\
+		prev = &curr->field.lfe_next;				\
+		curr = next;						\
+	}								\
+	*prevp = prev;							\
+	return (curr);							\
+}									\
+									\
+attr struct type *							\
+name##_LFLIST_INSERT(struct name *head, struct type *elm)		\
+{									\
+	struct type **prev, *curr;					\
+									\
+	for (;;) {							\
+		curr = name##_LFLIST_SEARCH(head, elm, &prev);		\
+		if (curr != NULL && (cmp)(curr, elm) == 0)		\
+			return (curr);					\
+		QUEUE_ATOMIC_STORE(&elm->field.lfe_next, curr, RELAXED);\
+		if (QUEUE_ATOMIC_CAS(prev, &curr, elm, RELEASE, RELAXED))\
+			return (NULL);					\
+	}								\
+}									\
+									\
+attr struct type *							\
+name##_LFLIST_REMOVE(struct name *head, struct type *elm)		\
+{									\
+	struct type **prev, *curr, *next, *expect;			\
+									\
+	for (;;) {							\
+		curr = name##_LFLIST_SEARCH(head, elm, &prev);		\
+		if (curr == NULL || (cmp)(curr, elm) != 0)		\
+			return (NULL);					\
+		next = QUEUE_ATOMIC_LOAD(&curr->field.lfe_next, ACQUIRE);\
+		if (LFLIST_IS_MARKED(next))				\
+			continue;	/* lost to another remover */	\
+		if (!QUEUE_ATOMIC_CAS(&curr->field.lfe_next, &next,	\
+		    LFLIST_MARK(type, next), ACQ_REL, RELAXED))		\
+			continue;					\
+		/* Marked, so ours; a search unlinks it if we cannot. */\
+		expect = curr;						\
+		if (!QUEUE_ATOMIC_CAS(prev, &expect, next, ACQ_REL, RELAXED))\
+			(void)name##_LFLIST_SEARCH(head, elm, &prev);	\
+		return (curr);						\
+	}								\
+}									\
+									\
+attr struct type *							\
+name##_LFLIST_FIND(struct name *head, struct type *elm)		\
+{									\
+	struct type *curr;						\
+	int comp;							\
+									\
+	curr = QUEUE_ATOMIC_LOAD(&head->lfh_first, ACQUIRE);		\
+	while (curr != NULL) {						\
+		comp = (cmp)(curr, elm);				\
+		if (comp >= 0)						\
+			break;						\
+		curr = LFLIST_UNMARK(type,				\
+		    QUEUE_ATOMIC_LOAD(&curr->field.lfe_next, ACQUIRE));	\
+	}								\
+	if (curr == NULL || comp != 0 || LFLIST_IS_MARKED(		\
+	    QUEUE_ATOMIC_LOAD(&curr->field.lfe_next, ACQUIRE)))		\
+		return (NULL);						\
+	return (curr);							\
+}									\
+									\
+attr struct type *							\
+name##_LFLIST_NEXT(struct type *elm)					\
+{									\
+	struct type *next;						\
+									\
+	next = LFLIST_UNMARK(type,					\
+	    QUEUE_ATOMIC_LOAD(&elm->field.lfe_next, ACQUIRE));		\
+	while (next != NULL && LFLIST_IS_MARKED(			\
+	    QUEUE_ATOMIC_LOAD(&next->field.lfe_next, ACQUIRE)))		\
+		next = LFLIST_UNMARK(type,				\
+		    QUEUE_ATOMIC_LOAD(&next->field.lfe_next, ACQUIRE));	\
+	return (next);							\
+}									\
+									\
+attr struct type *							\
+name##_LFLIST_FIRST(struct name *head)					\
+{									\
+	struct type *first;						\
+									\
+	first = QUEUE_ATOMIC_LOAD(&head->lfh_first, ACQUIRE);		\
+	if (first != NULL && LFLIST_IS_MARKED(				\
+	    QUEUE_ATOMIC_LOAD(&first->field.lfe_next, ACQUIRE)))	\
+		first = name##_LFLIST_NEXT(first);			\
+	return (first);							\
+}
@@ -0,0 +1,490 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+#include "../interfaces/Allocator.h"
+#include "../interfaces/CacheEvictor.h"
+#include "../interfaces/Mutex.h"
+
+/*
+ * Least-recently-used caches.
+ *
+ * An LRU cache links its entries on a TAILQ in recency order, most recent
+ * first, and indexes them by key in an HTABLE. Lookups that hit move the
+ * entry to the head of the list; inserts that take the cache past either of
+ * its limits evict from the tail. Limits are a number of entries and a total
+ * cost, where each entry is charged a caller-chosen cost (typically its size
+ * in bytes) when inserted; a limit of 0 is no limit.
+ *
+ * Entries embed an LRU_ENTRY, so the cache never allocates per entry. Hash
+ * buckets come from an Allocator instance and double as the cache fills,
+ * migrating incrementally as HTABLE does. Dropped entries, evicted or
+ * replaced by an insert for the same key, go to a CacheEvictor instance,
+ * which takes ownership; the evictor may be NULL if entries need no cleanup.
+ *
+ * An LRU cache is not thread safe. A sharded cache splits entries across a
+ * fixed, power-of-two number of LRU caches by key hash, each behind its own
+ * Mutex on its own cache line, so threads only contend when their keys land
+ * in the same shard. Since an entry can be evicted as soon as its shard is
+ * unlocked, sharded lookups hand the entry to a visitor while locked rather
+ * than returning it.
+ *
+ * Functions are emitted per cache type by LRU_GENERATE(), which takes the
+ * key type, the entry member holding the key, a hash function or macro,
+ * hash(key) -> size_t, and an equality function or macro, eq(key, key) ->
+ * int, as for FLATMAP_GENERATE():
+ *
+ *	struct page {
+ *		LRU_ENTRY(page) lru;
+ *		uint64_t number;
+ *		...
+ *	};
+ *	LRU_HEAD(pagecache, page);
+ *	LRU_GENERATE(pagecache, page, lru, uint64_t, number, hashPage, EQ_PAGE)
+ *
+ *	LRU_INIT(pagecache, &cache, allocator, evictor, 0, 64 << 20);
+ *	LRU_INSERT(pagecache, &cache, page, page->size);
+ *	page = LRU_FIND(pagecache, &cache, number);
+ *
+ *	LRU_SHARDED_HEAD(sharedpages, pagecache, 16);
+ *	LRU_SHARDED_GENERATE(sharedpages, pagecache, page, uint64_t, number,
+ *	    hashPage)
+ *
+ *	LRU_SHARDED_INIT(sharedpages, &shared, allocator, evictor,
+ *	    mutexFactory, 0, 64 << 20);
+ *	LRU_SHARDED_FIND(sharedpages, &shared, number, copyPage, &buffer);
+ */
+#ifndef LRU_INITIAL_BUCKETS
+#define	LRU_INITIAL_BUCKETS	16
+#endif
+
+/*
+ * LRU cache declarations.
+ */
+#define	LRU_BUCKET_HEAD(name)	HTABLE_BUCKET_HEAD(name##_lruindex)
+
+#define	LRU_HEAD(name, type)						\
+HTABLE_HEAD(name##_lruindex, type);					\
+TAILQ_HEAD(name##_lrulist, type);					\
+struct name {								\
+	struct name##_lruindex lh_index;	/* entries by key */	\
+	struct name##_lrulist lh_list;	/* most recently used first */	\
+	LRU_BUCKET_HEAD(name) *lh_retired; /* buckets being migrated */\
+	size_t lh_cost;			/* total cost of entries */	\
+	size_t lh_maxcount;		/* entry limit, or 0 */		\
+	size_t lh_maxcost;		/* cost limit, or 0 */		\
+	CacheEvictor *lh_evictor;	/* takes dropped entries */	\
+	Allocator *lh_allocator;	/* source of buckets */		\
+}
+
+#define	LRU_ENTRY(type)							\
+struct {								\
+	TAILQ_ENTRY(type) lre_link;	/* recency linkage */		\
+	HTABLE_ENTRY(type) lre_index;	/* key index linkage */		\
+	size_t lre_cost;		/* cost charged on insert */	\
+}
+
+/*
+ * LRU cache functions.
+ */
+#define	LRU_COUNT(cache)	HTABLE_COUNT(&(cache)->lh_index)
+#define	LRU_COST(cache)		((cache)->lh_cost)
+#define	LRU_EMPTY(cache)	HTABLE_EMPTY(&(cache)->lh_index)
+
+/* Most and least recently used entries. */
+#define	LRU_FIRST(cache)	TAILQ_FIRST(&(cache)->lh_list)
+#define	LRU_LAST(name, cache)	TAILQ_LAST(&(cache)->lh_list, name##_lrulist)
+
+#define	LRU_FOREACH(var, cache, field)					\
+	TAILQ_FOREACH((var), &(cache)->lh_list, field.lre_link)
+
+#define	LRU_INIT(name, cache, allocator, evictor, maxcount, maxcost)	\
+	name##_LRU_INIT((cache), (allocator), (evictor), (maxcount), (maxcost))
+#define	LRU_DESTROY(name, cache)	name##_LRU_DESTROY((cache))
+#define	LRU_FIND(name, cache, key)	name##_LRU_FIND((cache), (key))
+#define	LRU_PEEK(name, cache, key)	name##_LRU_PEEK((cache), (key))
+#define	LRU_INSERT(name, cache, elm, cost)				\
+	name##_LRU_INSERT((cache), (elm), (cost))
+#define	LRU_REMOVE(name, cache, elm)	name##_LRU_REMOVE((cache), (elm))
+#define	LRU_TRIM(name, cache)		name##_LRU_TRIM((cache))
+
+/*
+ * Emits the cache functions for struct name over struct type entries
+ * linked through field and keyed by their keyfield member:
+ *
+ *  - _LRU_INIT allocates the initial buckets; _LRU_DESTROY evicts every
+ *    entry and frees them. Both return the allocator's status.
+ *  - _LRU_FIND returns the entry for key, marking it most recently used,
+ *    or NULL. _LRU_PEEK does the same without touching recency.
+ *  - _LRU_INSERT adds elm as most recently used, dropping any entry with
+ *    the same key, then evicts until within limits. If elm alone is over
+ *    the cost limit it goes straight to the evictor and the cache is left
+ *    as it was. Returns the allocator's status; on failure elm is not
+ *    inserted and nothing is dropped.
+ *  - _LRU_REMOVE unlinks elm without evicting it.
+ *  - _LRU_TRIM evicts until within limits, after the limits are lowered.
+ */
+#define	LRU_GENERATE(name, type, field, keytype, keyfield, hash, eq)	\
+static __inline __unused AllocatorStatusType				\
+name##_LRU_INIT(struct name *cache, Allocator *allocator,		\
+    CacheEvictor *evictor, size_t maxcount, size_t maxcost)		\
+{									\
+	void *memory;							\
+	AllocatorStatusType status;					\
+									\
+	status = INVOKE(allocator, allocate, &memory,			\
+	    LRU_INITIAL_BUCKETS * sizeof(LRU_BUCKET_HEAD(name)), CALL_TRACE);\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	HTABLE_INIT(&cache->lh_index, (LRU_BUCKET_HEAD(name) *)memory,	\
+	    LRU_INITIAL_BUCKETS);					\
+	TAILQ_INIT(&cache->lh_list);					\
+	cache->lh_retired = NULL;					\
+	cache->lh_cost = 0;						\
+	cache->lh_maxcount = maxcount;					\
+	cache->lh_maxcost = maxcost;					\
+	cache->lh_evictor = evictor;					\
+	cache->lh_allocator = allocator;				\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+/* Frees the previous buckets once the index has migrated off them. */	\
+static __inline __unused AllocatorStatusType				\
+name##_LRU_RECLAIM(struct name *cache)					\
+{									\
+	void *memory = cache->lh_retired;				\
+									\
+	if (memory == NULL || HTABLE_RESIZING(&cache->lh_index))	\
+		return (AllocatorStatusSuccess);			\
+	cache->lh_retired = NULL;					\
+	return (INVOKE(cache->lh_allocator, free, &memory, CALL_TRACE));\
+}									\
+									\
+static __noinline __unused AllocatorStatusType				\
+name##_LRU_GROW(struct name *cache)					\
+{									\
+	size_t buckets = HTABLE_SIZE(&cache->lh_index) * 2;		\
+	void *memory;							\
+	AllocatorStatusType status;					\
+									\
+	if (cache->lh_retired != NULL) {				\
+		HTABLE_MIGRATE(&cache->lh_index,			\
+		    cache->lh_index.hth_oldmask + 1, type, field.lre_index);\
+		(void)name##_LRU_RECLAIM(cache);			\
+	}								\
+	status = INVOKE(cache->lh_allocator, allocate, &memory,		\
+	    buckets * sizeof(LRU_BUCKET_HEAD(name)), CALL_TRACE);	\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	cache->lh_retired = cache->lh_index.hth_buckets;		\
+	HTABLE_RESIZE(&cache->lh_index, (LRU_BUCKET_HEAD(name) *)memory,\
+	    buckets, type, field.lre_index);				\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_LRU_LOOKUP(struct name *cache, keytype key, size_t h)		\
+{									\
+	struct type *elm;						\
+									\
+	HTABLE_FIND(&cache->lh_index, elm, h, field.lre_index,		\
+	    eq(elm->keyfield, key));					\
+	return (elm);							\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_LRU_PEEK(struct name *cache, keytype key)			\
+{									\
+	return (name##_LRU_LOOKUP(cache, key, (size_t)(hash(key))));	\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_LRU_TOUCH(struct name *cache, struct type *elm)			\
+{									\
+	if (elm != NULL && elm != TAILQ_FIRST(&cache->lh_list)) {	\
+		TAILQ_REMOVE(&cache->lh_list, elm, field.lre_link);	\
+		TAILQ_INSERT_HEAD(&cache->lh_list, elm, field.lre_link);\
+	}								\
+	return (elm);							\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_LRU_FIND(struct name *cache, keytype key)			\
+{									\
+	return (name##_LRU_TOUCH(cache, name##_LRU_PEEK(cache, key)));	\
+}									\
+									\
+static __inline __unused void						\
+name##_LRU_REMOVE(struct name *cache, struct type *elm)			\
+{									\
+	HTABLE_REMOVE(&cache->lh_index, elm, type, field.lre_index);	\
+	TAILQ_REMOVE(&cache->lh_list, elm, field.lre_link);		\
+	cache->lh_cost -= elm->field.lre_cost;				\
+	(void)name##_LRU_RECLAIM(cache);				\
+}									\
+									\
+static __inline __unused void						\
+name##_LRU_EVICT(struct name *cache, struct type *elm)			\
+{									\
+	name##_LRU_REMOVE(cache, elm);					\
+	if (cache->lh_evictor != NULL)					\
+		INVOKE(cache->lh_evictor, evict, elm, elm->field.lre_cost);\
+}									\
+									\
+static __inline __unused void						\
+name##_LRU_TRIM(struct name *cache)					\
+{									\
+	while ((cache->lh_maxcount != 0 &&				\
+	    LRU_COUNT(cache) > cache->lh_maxcount) ||			\
+	    (cache->lh_maxcost != 0 && cache->lh_cost > cache->lh_maxcost))\
+		name##_LRU_EVICT(cache, LRU_LAST(name, cache));		\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_LRU_INSERT_HASHED(struct name *cache, struct type *elm,		\
+    size_t cost, size_t h)						\
+{									\
+	struct type *old = name##_LRU_LOOKUP(cache, elm->keyfield, h);	\
+	AllocatorStatusType status;					\
+									\
+	if (cache->lh_maxcost != 0 && cost > cache->lh_maxcost) {	\
+		/* Linking it would evict everything else first. */	\
+		if (cache->lh_evictor != NULL)				\
+			INVOKE(cache->lh_evictor, evict, elm, cost);	\
+		return (AllocatorStatusSuccess);			\
+	}								\
+	if (old == NULL && LRU_COUNT(cache) >= HTABLE_SIZE(&cache->lh_index)) {\
+		status = name##_LRU_GROW(cache);			\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+	}								\
+	if (old != NULL)						\
+		name##_LRU_EVICT(cache, old);				\
+	elm->field.lre_cost = cost;					\
+	HTABLE_INSERT(&cache->lh_index, elm, h, type, field.lre_index);	\
+	TAILQ_INSERT_HEAD(&cache->lh_list, elm, field.lre_link);	\
+	cache->lh_cost += cost;						\
+	name##_LRU_TRIM(cache);						\
+	/* elm is linked, so a failed free only leaks the old buckets. */\
+	(void)name##_LRU_RECLAIM(cache);				\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_LRU_INSERT(struct name *cache, struct type *elm, size_t cost)	\
+{									\
+	return (name##_LRU_INSERT_HASHED(cache, elm, cost,		\
+	    (size_t)(hash(elm->keyfield))));				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_LRU_DESTROY(struct name *cache)					\
+{									\
+	void *memory;							\
+	AllocatorStatusType status = AllocatorStatusSuccess;		\
+									\
+	while (!LRU_EMPTY(cache))					\
+		name##_LRU_EVICT(cache, LRU_LAST(name, cache));		\
+	memory = cache->lh_retired;					\
+	if (memory != NULL && INVOKE(cache->lh_allocator, free, &memory,\
+	    CALL_TRACE) != AllocatorStatusSuccess)			\
+		status = AllocatorStatusFailure;			\
+	memory = cache->lh_index.hth_buckets;				\
+	if (INVOKE(cache->lh_allocator, free, &memory, CALL_TRACE) !=	\
+	    AllocatorStatusSuccess)					\
+		status = AllocatorStatusFailure;			\
+	cache->lh_retired = NULL;					\
+	cache->lh_index.hth_buckets = NULL;				\
+	return (status);						\
+}
+
+/*
+ * Sharded LRU cache declarations.
+ */
+#define	LRU_SHARDED_HEAD(sname, name, nshards)				\
+struct sname##_lrushard {						\
+	Mutex *ls_lock QUEUE_CACHE_ALIGNED; /* guards ls_cache */	\
+	struct name ls_cache;						\
+};									\
+struct sname {								\
+	struct sname##_lrushard lsh_shards[(nshards)];			\
+	MutexFactory *lsh_factory;	/* source of shard locks */	\
+}
+
+/*
+ * Sharded LRU cache functions.
+ */
+#define	LRU_SHARDS(cache)						\
+	(sizeof((cache)->lsh_shards) / sizeof((cache)->lsh_shards[0]))
+
+/*
+ * Shard for a hash. Fibonacci hashing takes the shard from the product's
+ * top bits, by scaling its upper half to the shard count, leaving the
+ * hash's low bits, which pick buckets, spread evenly within every shard.
+ */
+#define	LRU_SHARD(cache, h)						\
+	(&(cache)->lsh_shards[(size_t)(((((uint64_t)(h) *		\
+	    UINT64_C(0x9e3779b97f4a7c15)) >> 32) *			\
+	    (uint64_t)LRU_SHARDS((cache))) >> 32)])
+
+#define	LRU_SHARDED_INIT(sname, cache, allocator, evictor, factory,	\
+    maxcount, maxcost)							\
+	sname##_LRU_SHARDED_INIT((cache), (allocator), (evictor),	\
+	    (factory), (maxcount), (maxcost))
+#define	LRU_SHARDED_DESTROY(sname, cache)				\
+	sname##_LRU_SHARDED_DESTROY((cache))
+#define	LRU_SHARDED_FIND(sname, cache, key, visit, arg)			\
+	sname##_LRU_SHARDED_FIND((cache), (key), (visit), (arg))
+#define	LRU_SHARDED_INSERT(sname, cache, elm, cost)			\
+	sname##_LRU_SHARDED_INSERT((cache), (elm), (cost))
+#define	LRU_SHARDED_REMOVE(sname, cache, key)				\
+	sname##_LRU_SHARDED_REMOVE((cache), (key))
+
+/*
+ * Emits the sharded cache functions for struct sname over struct name
+ * caches, which LRU_GENERATE() must already have emitted with the same
+ * key type, key member and hash:
+ *
+ *  - _LRU_SHARDED_INIT creates a lock per shard and splits the limits
+ *    evenly, rounding up. _LRU_SHARDED_DESTROY evicts every entry and
+ *    releases the shards. Both return the allocator's status; a lock that
+ *    cannot be created fails initialisation.
+ *  - _LRU_SHARDED_FIND calls visit(elm, arg) with the entry for key, under
+ *    its shard lock and marked most recently used, and returns 1; or
+ *    returns 0 if there is none.
+ *  - _LRU_SHARDED_INSERT inserts as _LRU_INSERT, within elm's shard.
+ *  - _LRU_SHARDED_REMOVE unlinks and returns the entry for key, which the
+ *    caller then owns, or NULL.
+ *
+ * The evictor is called with a shard lock held.
+ */
+#define	LRU_SHARDED_GENERATE(sname, name, type, keytype, keyfield, hash)\
+static __inline __unused AllocatorStatusType				\
+sname##_LRU_SHARDED_DESTROY(struct sname *cache)			\
+{									\
+	struct sname##_lrushard *shard;					\
+	AllocatorStatusType status = AllocatorStatusSuccess;		\
+	size_t index;							\
+									\
+	for (index = 0; index < LRU_SHARDS(cache); index++) {		\
+		shard = &cache->lsh_shards[index];			\
+		if (shard->ls_lock == NULL)				\
+			continue;					\
+		if (name##_LRU_DESTROY(&shard->ls_cache) !=		\
+		    AllocatorStatusSuccess)				\
+			status = AllocatorStatusFailure;		\
+		INVOKE(cache->lsh_factory, remove, &shard->ls_lock);	\
+		shard->ls_lock = NULL;					\
+	}								\
+	return (status);						\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+sname##_LRU_SHARDED_INIT(struct sname *cache, Allocator *allocator,	\
+    CacheEvictor *evictor, MutexFactory *factory, size_t maxcount,	\
+    size_t maxcost)							\
+{									\
+	struct sname##_lrushard *shard;					\
+	size_t index, shards = LRU_SHARDS(cache);			\
+	AllocatorStatusType status;					\
+									\
+	cache->lsh_factory = factory;					\
+	for (index = 0; index < shards; index++)			\
+		cache->lsh_shards[index].ls_lock = NULL;		\
+	for (index = 0; index < shards; index++) {			\
+		shard = &cache->lsh_shards[index];			\
+		status = name##_LRU_INIT(&shard->ls_cache, allocator,	\
+		    evictor, (maxcount + shards - 1) / shards,		\
+		    (maxcost + shards - 1) / shards);			\
+		if (status == AllocatorStatusSuccess &&			\
+		    INVOKE(factory, create, &shard->ls_lock) !=		\
+		    MutexStatusSuccess) {				\
+			name##_LRU_DESTROY(&shard->ls_cache);		\
+			shard->ls_lock = NULL;				\
+			status = AllocatorStatusFailure;		\
+		}							\
+		if (status != AllocatorStatusSuccess) {			\
+			sname##_LRU_SHARDED_DESTROY(cache);		\
+			return (status);				\
+		}							\
+	}								\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused int						\
+sname##_LRU_SHARDED_FIND(struct sname *cache, keytype key,		\
+    void (*visit)(struct type *, void *), void *arg)			\
+{									\
+	size_t h = (size_t)(hash(key));					\
+	struct sname##_lrushard *shard = LRU_SHARD(cache, h);		\
+	struct type *elm;						\
+									\
+	INVOKE(shard->ls_lock, acquire);				\
+	elm = name##_LRU_TOUCH(&shard->ls_cache,			\
+	    name##_LRU_LOOKUP(&shard->ls_cache, key, h));		\
+	if (elm != NULL)						\
+		visit(elm, arg);					\
+	INVOKE(shard->ls_lock, release);				\
+	return (elm != NULL);						\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+sname##_LRU_SHARDED_INSERT(struct sname *cache, struct type *elm,	\
+    size_t cost)							\
+{									\
+	size_t h = (size_t)(hash(elm->keyfield));			\
+	struct sname##_lrushard *shard = LRU_SHARD(cache, h);		\
+	AllocatorStatusType status;					\
+									\
+	INVOKE(shard->ls_lock, acquire);				\
+	status = name##_LRU_INSERT_HASHED(&shard->ls_cache, elm, cost, h);\
+	INVOKE(shard->ls_lock, release);				\
+	return (status);						\
+}									\
+									\
+static __inline __unused struct type *					\
+sname##_LRU_SHARDED_REMOVE(struct sname *cache, keytype key)		\
+{									\
+	size_t h = (size_t)(hash(key));					\
+	struct sname##_lrushard *shard = LRU_SHARD(cache, h);		\
+	struct type *elm;						\
+									\
+	INVOKE(shard->ls_lock, acquire);				\
+	elm = name##_LRU_LOOKUP(&shard->ls_cache, key, h);		\
+	if (elm != NULL)						\
+		name##_LRU_REMOVE(&shard->ls_cache, elm);		\
+	INVOKE(shard->ls_lock, release);				\
+	return (elm);							\
+}
@@ -0,0 +1,290 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include "queue.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define	MPMC_YIELD()	SwitchToThread()
+#else
+#include <sched.h>
+#define	MPMC_YIELD()	sched_yield()
+#endif /* _WIN32 */
+
+/*
+ * Bounded multi-producer multi-consumer array queues.
+ *
+ * An MPMC queue is headed by an enqueue position, a dequeue position and a
+ * power-of-two sized cell array supplied by the caller. Each cell carries a
+ * sequence number next to its value (see Vyukov's bounded MPMC queue): a
+ * cell is free for the producer at position pos when its sequence equals
+ * pos, and ready for the consumer at pos when it equals pos + 1. Producers
+ * and consumers therefore only contend on their own position counter and
+ * hand values off through the cells, with no lock and no allocation.
+ *
+ * Bulk operations claim a run of consecutive positions with a single
+ * compare-and-swap, amortising the contended update over the whole run.
+ * Values are stored by copy.
+ *
+ * Functions are emitted per queue type by MPMC_GENERATE() and reached
+ * through the wrapper macros:
+ *
+ *	MPMC_HEAD(jobq, struct job *);
+ *	MPMC_GENERATE(jobq, struct job *)
+ *
+ *	static MPMC_CELL(jobq) cells[ 4096 ];
+ *	struct jobq queue;
+ *	MPMC_INIT(jobq, &queue, cells, 4096);
+ *	MPMC_ENQUEUE(jobq, &queue, &job);
+ */
+
+/*
+ * MPMC queue declarations.
+ */
+#define	MPMC_CELL(name)	struct name##_mpmc_cell
+
+#define	MPMC_HEAD(name, type)						\
+MPMC_CELL(name) {							\
+	size_t mc_seq;		/* lap stamp, see above */		\
+	type mc_value;							\
+};									\
+struct name {								\
+	size_t mh_enqueue QUEUE_CACHE_ALIGNED;	/* next to fill */	\
+	size_t mh_dequeue QUEUE_CACHE_ALIGNED;	/* next to drain */	\
+	MPMC_CELL(name) *mh_cells QUEUE_CACHE_ALIGNED;			\
+	size_t mh_mask;		/* capacity - 1 */			\
+}
+
+/*
+ * MPMC queue functions.
+ */
+#define	MPMC_CAPACITY(queue)	((queue)->mh_mask + 1)
+
+/* Capacity must be a power of two; cells must hold capacity entries. */
+#define	MPMC_INIT(name, queue, cells, capacity)				\
+	name##_MPMC_INIT((queue), (cells), (capacity))
+#define	MPMC_TRY_ENQUEUE(name, queue, elmp)				\
+	name##_MPMC_TRY_ENQUEUE((queue), (elmp))
+#define	MPMC_TRY_DEQUEUE(name, queue, elmp)				\
+	name##_MPMC_TRY_DEQUEUE((queue), (elmp))
+#define	MPMC_ENQUEUE_BULK(name, queue, elms, n)				\
+	name##_MPMC_ENQUEUE_BULK((queue), (elms), (n))
+#define	MPMC_DEQUEUE_BULK(name, queue, elms, n)				\
+	name##_MPMC_DEQUEUE_BULK((queue), (elms), (n))
+#define	MPMC_ENQUEUE(name, queue, elmp)					\
+	name##_MPMC_ENQUEUE((queue), (elmp))
+#define	MPMC_DEQUEUE(name, queue, elmp)					\
+	name##_MPMC_DEQUEUE((queue), (elmp))
+
+/* Spins this many times before yielding in the blocking variants. */
+#ifndef MPMC_SPIN_LIMIT
+#define	MPMC_SPIN_LIMIT	64
+#endif
+
+#define	MPMC_BACKOFF(spins) MULTI_LINE_MACRO_BEGIN			\
+	if ((spins) < MPMC_SPIN_LIMIT) {				\
+		(spins)++;						\
+		QUEUE_CPU_RELAX();					\
+	} else								\
+		MPMC_YIELD();						\
+MULTI_LINE_MACRO_END
+
+/*
+ * Emits the queue functions for struct name holding elements of type:
+ *
+ *  - _MPMC_TRY_ENQUEUE/_MPMC_TRY_DEQUEUE move one element and return 1, or
+ *    0 if the queue was full/empty.
+ *  - _MPMC_ENQUEUE_BULK/_MPMC_DEQUEUE_BULK move up to n elements and return
+ *    how many were moved; 0 means full/empty.
+ *  - _MPMC_ENQUEUE/_MPMC_DEQUEUE block until the element could be moved,
+ *    spinning briefly before yielding the processor.
+ */
+#define	MPMC_GENERATE(name, type)					\
+static __inline __unused void						\
+name##_MPMC_INIT(struct name *queue, MPMC_CELL(name) *cells,		\
+    size_t capacity)							\
+{									\
+	size_t index;							\
+									\
+	for (index = 0; index < capacity; index++)			\
+		cells[index].mc_seq = index;				\
+	queue->mh_cells = cells;					\
+	queue->mh_mask = capacity - 1;					\
+	QUEUE_ATOMIC_STORE(&queue->mh_enqueue, 0, RELAXED);		\
+	QUEUE_ATOMIC_STORE(&queue->mh_dequeue, 0, RELEASE);		\
+}									\
+									\
+static __inline __unused size_t						\
+name##_MPMC_ENQUEUE_BULK(struct name *queue, const type *elms,		\
+    size_t n)								\
+{									\
+	MPMC_CELL(name) *cell;						\
+	size_t pos = QUEUE_ATOMIC_LOAD(&queue->mh_enqueue, RELAXED);	\
+	size_t count, index;						\
+									\
+	if (n > MPMC_CAPACITY(queue))					\
+		n = MPMC_CAPACITY(queue);				\
+	for (;;) {							\
+		/* Count the run of cells free for this lap. */		\
+		for (count = 0; count < n; count++) {			\
+			cell = &queue->mh_cells[(pos + count) & queue->mh_mask];\
+			if (QUEUE_ATOMIC_LOAD(&cell->mc_seq, ACQUIRE) !=	\
+			    pos + count)				\
+				break;					\
+		}							\
+		if (count > 0) {					\
+			if (QUEUE_ATOMIC_CAS_WEAK(&queue->mh_enqueue, &pos,\
+			    pos + count, RELAXED, RELAXED))		\
+				break;					\
+			continue;					\
+		}							\
+		/* A lagging stamp means a full lap; otherwise we lost. */\
+		cell = &queue->mh_cells[pos & queue->mh_mask];		\
+		if ((ptrdiff_t)(QUEUE_ATOMIC_LOAD(&cell->mc_seq, ACQUIRE) -\
+		    pos) < 0)						\
+			return (0);					\
+		pos = QUEUE_ATOMIC_LOAD(&queue->mh_enqueue, RELAXED);	\
+	}								\
+	for (index = 0; index < count; index++) {			\
+		cell = &queue->mh_cells[(pos + index) & queue->mh_mask];\
+		cell->mc_value = elms[index];				\
+		QUEUE_ATOMIC_STORE(&cell->mc_seq, pos + index + 1, RELEASE);\
+	}								\
+	return (count);							\
+}									\
+									\
+static __inline __unused size_t						\
+name##_MPMC_DEQUEUE_BULK(struct name *queue, type *elms, size_t n)	\
+{									\
+	MPMC_CELL(name) *cell;						\
+	size_t pos = QUEUE_ATOMIC_LOAD(&queue->mh_dequeue, RELAXED);	\
+	size_t count, index;						\
+									\
+	if (n > MPMC_CAPACITY(queue))					\
+		n = MPMC_CAPACITY(queue);				\
+	for (;;) {							\
+		for (count = 0; count < n; count++) {			\
+			cell = &queue->mh_cells[(pos + count) & queue->mh_mask];\
+			if (QUEUE_ATOMIC_LOAD(&cell->mc_seq, ACQUIRE) !=	\
+			    pos + count + 1)				\
+				break;					\
+		}							\
+		if (count > 0) {					\
+			if (QUEUE_ATOMIC_CAS_WEAK(&queue->mh_dequeue, &pos,\
+			    pos + count, RELAXED, RELAXED))		\
+				break;					\
+			continue;					\
+		}							\
+		cell = &queue->mh_cells[pos & queue->mh_mask];		\
+		if ((ptrdiff_t)(QUEUE_ATOMIC_LOAD(&cell->mc_seq, ACQUIRE) -\
+		    (pos + 1)) < 0)					\
+			return (0);					\
+		pos = QUEUE_ATOMIC_LOAD(&queue->mh_dequeue, RELAXED);	\
+	}								\
+	for (index = 0; index < count; index++) {			\
+		cell = &queue->mh_cells[(pos + index) & queue->mh_mask];\
+		elms[index] = cell->mc_value;				\
+		QUEUE_ATOMIC_STORE(&cell->mc_seq,			\
+		    pos + index + MPMC_CAPACITY(queue), RELEASE);	\
+	}								\
+	return (count);							\
+}									\
+									\
+static __inline __unused int						\
+name##_MPMC_TRY_ENQUEUE(struct name *queue, const type *elm)		\
+{									\
+	MPMC_CELL(name) *cell;						\
+	size_t pos = QUEUE_ATOMIC_LOAD(&queue->mh_enqueue, RELAXED);	\
+	ptrdiff_t diff;							\
+									\
+	for (;;) {							\
+		cell = &queue->mh_cells[pos & queue->mh_mask];		\
+		diff = (ptrdiff_t)(QUEUE_ATOMIC_LOAD(&cell->mc_seq, ACQUIRE) -\
+		    pos);						\
+		if (diff == 0) {					\
+			if (QUEUE_ATOMIC_CAS_WEAK(&queue->mh_enqueue, &pos,\
+			    pos + 1, RELAXED, RELAXED))			\
+				break;					\
+		} else if (diff < 0)					\
+			return (0);					\
+		else							\
+			pos = QUEUE_ATOMIC_LOAD(&queue->mh_enqueue, RELAXED);\
+	}								\
+	cell->mc_value = *elm;						\
+	QUEUE_ATOMIC_STORE(&cell->mc_seq, pos + 1, RELEASE);		\
+	return (1);							\
+}									\
+									\
+static __inline __unused int						\
+name##_MPMC_TRY_DEQUEUE(struct name *queue, type *elm)			\
+{									\
+	MPMC_CELL(name) *cell;						\
+	size_t pos = QUEUE_ATOMIC_LOAD(&queue->mh_dequeue, RELAXED);	\
+	ptrdiff_t diff;							\
+									\
+	for (;;) {							\
+		cell = &queue->mh_cells[pos & queue->mh_mask];		\
+		diff = (ptrdiff_t)(QUEUE_ATOMIC_LOAD(&cell->mc_seq, ACQUIRE) -\
+		    (pos + 1));						\
+		if (diff == 0) {					\
+			if (QUEUE_ATOMIC_CAS_WEAK(&queue->mh_dequeue, &pos,\
+			    pos + 1, RELAXED, RELAXED))			\
+				break;					\
+		} else if (diff < 0)					\
+			return (0);					\
+		else							\
+			pos = QUEUE_ATOMIC_LOAD(&queue->mh_dequeue, RELAXED);\
+	}								\
+	*elm = cell->mc_value;						\
+	QUEUE_ATOMIC_STORE(&cell->mc_seq, pos + MPMC_CAPACITY(queue), RELEASE);\
+	return (1);							\
+}									\
+									\
+static __inline __unused void						\
+name##_MPMC_ENQUEUE(struct name *queue, const type *elm)		\
+{									\
+	unsigned spins = 0;						\
+									\
+	while (!name##_MPMC_TRY_ENQUEUE(queue, elm))			\
+		MPMC_BACKOFF(spins);					\
+}									\
+									\
+static __inline __unused void						\
+name##_MPMC_DEQUEUE(struct name *queue, type *elm)			\
+{									\
+	unsigned spins = 0;						\
+									\
+	while (!name##_MPMC_TRY_DEQUEUE(queue, elm))			\
+		MPMC_BACKOFF(spins);					\
+}
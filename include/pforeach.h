@@ -0,0 +1,220 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <string.h>
+#include "queue.h"
+#include "../interfaces/Allocator.h"
+#include "../interfaces/Executor.h"
+
+/*
+ * Parallel traversal of singly-linked and doubly-linked tail queues.
+ *
+ * A sweep over a long list, such as expiring entries or summing counters,
+ * is split into chunks of a fixed number of elements, and the chunks are
+ * visited as tasks on an Executor instance's workers. The list itself is
+ * still walked once, serially, to find where each chunk starts; these skip
+ * pointers are kept in a plan, in memory from an Allocator instance, and
+ * may be reused by later sweeps for as long as the list is not modified.
+ * Only the visits run in parallel, so the payoff grows with the work done
+ * per element, and is largest when a plan serves several sweeps.
+ *
+ * Each worker accumulates into its own element of an array of accumulators
+ * supplied by the caller, one per worker (see PFOREACH_WORKERS()), which
+ * the caller initialises before the sweep and combines after it; workers
+ * therefore share nothing while visiting. Pad the accumulator type to a
+ * cache line if it is written per element.
+ *
+ * Functions are emitted per list type by PFOREACH_GENERATE(), which takes
+ * the list family, STAILQ or TAILQ, the head and element types, the link
+ * field, the accumulator type and a visit function or macro, visit(elm,
+ * acc), with acc pointing at the worker's accumulator. Visits may modify
+ * their element, but must not link or unlink elements, and nothing else
+ * may while a sweep runs.
+ *
+ * Linking or unlinking any element invalidates the plan, which then needs
+ * another serial PFOREACH_PARTITION() walk. A sweep that removes elements,
+ * such as an expiry sweep, should therefore have each worker collect its
+ * victims in its accumulator, then unlink them all after PFOREACH_RUN()
+ * returns, and partition again only when the next sweep is due:
+ *
+ *	struct expiry {
+ *		VECTOR_HEAD(sessionvec, struct session *) expired;
+ *	} __aligned(QUEUE_CACHE_LINE_SIZE);
+ *	PFOREACH_PLAN(sessionsweep, session);
+ *	PFOREACH_GENERATE(sessionsweep, TAILQ, sessionlist, session, link,
+ *	    struct expiry, collectExpired)
+ *
+ *	struct expiry accs[PFOREACH_WORKERS(executor)];
+ *	PFOREACH_INIT(sessionsweep, &plan, allocator, 4096);
+ *	PFOREACH_PARTITION(sessionsweep, &plan, &sessions);
+ *	PFOREACH_RUN(sessionsweep, &plan, executor, accs);
+ *	for each worker's accs[w].expired, each session in it:
+ *		TAILQ_REMOVE(&sessions, session, link);
+ *
+ * A NULL executor visits every chunk on the calling thread, as worker 0.
+ */
+
+/*
+ * Parallel traversal declarations.
+ */
+#define	PFOREACH_PLAN(name, type)					\
+struct name {								\
+	struct type **pfp_chunks;	/* first element of each chunk */\
+	size_t pfp_count;		/* chunks */			\
+	size_t pfp_capacity;		/* length of pfp_chunks */	\
+	size_t pfp_chunksize;		/* elements per chunk */	\
+	Allocator *pfp_allocator;	/* source of pfp_chunks */	\
+}
+
+/*
+ * Parallel traversal functions.
+ */
+#define	PFOREACH_WORKERS(executor)					\
+	((executor) != NULL ? (executor)->workers : 1)
+
+#define	PFOREACH_INIT(name, plan, allocator, chunksize)			\
+	name##_PFOREACH_INIT((plan), (allocator), (chunksize))
+#define	PFOREACH_DESTROY(name, plan)	name##_PFOREACH_DESTROY((plan))
+#define	PFOREACH_PARTITION(name, plan, head)				\
+	name##_PFOREACH_PARTITION((plan), (head))
+#define	PFOREACH_RUN(name, plan, executor, accs)			\
+	name##_PFOREACH_RUN((plan), (executor), (accs))
+
+/*
+ * Emits the parallel traversal functions for struct name plans over family
+ * lists headed by struct headname, of struct type elements linked through
+ * field:
+ *
+ *  - _PFOREACH_INIT sets up an empty plan of chunksize-element chunks.
+ *  - _PFOREACH_DESTROY frees the plan's skip pointers.
+ *  - _PFOREACH_PARTITION walks head, recording the start of each chunk.
+ *  - _PFOREACH_RUN visits every element of the partitioned list, one task
+ *    per chunk, and returns once all are done.
+ */
+#define	PFOREACH_GENERATE(name, family, headname, type, field, acctype, visit)\
+struct name##_pforeach_context {					\
+	struct name *plan;						\
+	acctype *accs;							\
+};									\
+									\
+static __inline __unused void						\
+name##_PFOREACH_INIT(struct name *plan, Allocator *allocator,		\
+    size_t chunksize)							\
+{									\
+	plan->pfp_chunks = NULL;					\
+	plan->pfp_count = plan->pfp_capacity = 0;			\
+	plan->pfp_chunksize = chunksize > 0 ? chunksize : 1;		\
+	plan->pfp_allocator = allocator;				\
+}									\
+									\
+static __inline __unused void						\
+name##_PFOREACH_DESTROY(struct name *plan)				\
+{									\
+	void *memory = plan->pfp_chunks;				\
+									\
+	if (memory != NULL)						\
+		(void)INVOKE(plan->pfp_allocator, free, &memory, CALL_TRACE);\
+	plan->pfp_chunks = NULL;					\
+	plan->pfp_count = plan->pfp_capacity = 0;			\
+}									\
+									\
+static __noinline __unused AllocatorStatusType				\
+name##_PFOREACH_GROW(struct name *plan)					\
+{									\
+	size_t capacity = plan->pfp_capacity ? plan->pfp_capacity * 2 : 16;\
+	void *memory, *old = plan->pfp_chunks;				\
+	AllocatorStatusType status;					\
+									\
+	status = INVOKE(plan->pfp_allocator, allocate, &memory,		\
+	    capacity * sizeof(struct type *), CALL_TRACE);		\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	if (old != NULL) {						\
+		memcpy(memory, old, plan->pfp_count * sizeof(struct type *));\
+		(void)INVOKE(plan->pfp_allocator, free, &old, CALL_TRACE);\
+	}								\
+	plan->pfp_chunks = (struct type **)memory;			\
+	plan->pfp_capacity = capacity;					\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_PFOREACH_PARTITION(struct name *plan, struct headname *head)	\
+{									\
+	struct type *elm;						\
+	size_t n = 0;							\
+									\
+	plan->pfp_count = 0;						\
+	family##_FOREACH(elm, head, field) {				\
+		if (n++ % plan->pfp_chunksize != 0)			\
+			continue;					\
+		if (plan->pfp_count == plan->pfp_capacity &&		\
+		    name##_PFOREACH_GROW(plan) != AllocatorStatusSuccess) {\
+			plan->pfp_count = 0;				\
+			return (AllocatorStatusFailure);		\
+		}							\
+		plan->pfp_chunks[plan->pfp_count++] = elm;		\
+	}								\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __unused void							\
+name##_PFOREACH_TASK(void *context, size_t index, size_t worker)	\
+{									\
+	struct name##_pforeach_context *run =				\
+	    (struct name##_pforeach_context *)context;			\
+	struct type *elm = run->plan->pfp_chunks[index];		\
+	struct type *end = index + 1 < run->plan->pfp_count ?		\
+	    run->plan->pfp_chunks[index + 1] : NULL;			\
+									\
+	for (; elm != end; elm = family##_NEXT(elm, field))		\
+		visit(elm, &run->accs[worker]);				\
+}									\
+									\
+static __inline __unused ExecutorStatusType				\
+name##_PFOREACH_RUN(struct name *plan, Executor *executor, acctype *accs)\
+{									\
+	struct name##_pforeach_context run;				\
+	size_t index;							\
+									\
+	run.plan = plan;						\
+	run.accs = accs;						\
+	if (executor == NULL || plan->pfp_count < 2) {			\
+		for (index = 0; index < plan->pfp_count; index++)	\
+			name##_PFOREACH_TASK(&run, index, 0);		\
+		return (ExecutorStatusSuccess);				\
+	}								\
+	return (INVOKE(executor, run, name##_PFOREACH_TASK, &run,	\
+	    plan->pfp_count));						\
+}
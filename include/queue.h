@@ -33,6 +33,7 @@
 #ifndef _SYS_QUEUE_H_
 #define	_SYS_QUEUE_H_
 
+#include <stddef.h>
 #include "cdefs.h"
 
 
@@ -88,6 +89,27 @@
  * after an existing element, at the head of the list, or at the end of
  * the list. A tail queue may be traversed in either direction.
  *
+ * A multi-producer single-consumer queue (MPSCQ) is headed by a producer
+ * pointer to the most recently pushed element, a consumer pointer to the
+ * oldest element and an embedded stub element. Any number of threads may
+ * push concurrently with a single consumer popping; push is wait-free (one
+ * atomic exchange) and nothing is allocated. Elements may only be removed
+ * from the head of the queue and it may only be traversed by popping. The
+ * lock-free families require the GCC/clang __atomic builtins.
+ *
+ * A hash table (HTABLE) is headed by an array of list heads supplied by the
+ * caller, one per bucket, with elements linked into buckets by a list entry
+ * that also records the element's hash. Resizing never rehashes in one go:
+ * the caller hands over a new bucket array and every subsequent insert or
+ * removal migrates a few of the old buckets, with lookups consulting both
+ * arrays until migration is complete.
+ *
+ * Each list family also has a _GENERATE macro emitting static inline
+ * functions, prefix_SLIST_INSERT_HEAD() and so on, that wrap its macros for
+ * one head and element type. Calls are type checked, and since the compiler
+ * is free to outline the larger bodies, code with many call sites need not
+ * carry a copy of each at every one.
+ *
  * For details on the use of these macros, see the queue(3) manual page.
  *
  *
@@ -111,17 +133,202 @@
  * _FOREACH_REVERSE_FROM	-	-	-	+
  * _FOREACH_REVERSE_SAFE	-	-	-	+
  * _FOREACH_REVERSE_FROM_SAFE	-	-	-	+
+ * _FOREACH_PREFETCH		+	+	+	+
  * _INSERT_HEAD			+	+	+	+
  * _INSERT_BEFORE		-	+	-	+
  * _INSERT_AFTER		+	+	+	+
  * _INSERT_TAIL			-	-	+	+
- * _CONCAT			-	-	+	+
+ * _CONCAT			-	+	+	+
+ * _SPLICE			-	-	-	+
+ * _SPLICE_AFTER		-	-	-	+
+ * _SPLIT_AFTER			-	-	-	+
+ * _REVERSE			+	-	-	-
+ * _SORT			+	-	+	+
  * _REMOVE_AFTER		+	-	+	-
  * _REMOVE_HEAD			+	-	+	-
  * _REMOVE			+	+	+	+
  * _SWAP			+	+	+	+
+ * _GENERATE			+	+	+	+
+ *
+ *
+ *				MPSCQ	HTABLE
+ * _HEAD			+	+
+ * _HEAD_INITIALIZER		+	-
+ * _ENTRY			+	+
+ * _INIT			+	+
+ * _EMPTY			+	+
+ * _PUSH			+	-
+ * _POP				+	-
+ * _INSERT			-	+
+ * _FIND			-	+
+ * _REMOVE			-	+
+ * _RESIZE			-	+
+ *
+ */
+/*
+ * Debugging.
+ *
+ * QUEUE_MACRO_DEBUG records in each tail queue head and element the last
+ * two places it was altered, checks the links around every doubly-linked
+ * list and tail queue operation, aborting on corruption, and poisons the
+ * links of removed elements.
+ *
+ * Defining QUEUE_MACRO_DEBUG_SAMPLE to N records and checks only every Nth
+ * operation of each thread, which makes it cheap enough to leave enabled
+ * in production: corruption of a hot list is still caught soon after it
+ * happens. Poisoning is unconditional.
+ *
+ * QUEUE_MACRO_DEBUG_COUNTERS, with or without QUEUE_MACRO_DEBUG, counts the
+ * operations performed with each list macro, in qmd_op_counts[], indexed
+ * by QMD_OP_ and the macro name, as in qmd_op_counts[QMD_OP_TAILQ_REMOVE].
+ * One source file must expand QUEUE_MACRO_DEBUG_COUNTERS_DEFINE at file
+ * scope to hold them. With sampling, threads count privately and publish
+ * their counts on each sampled operation, so the totals lag by less than N
+ * operations per thread. Without it every operation is an atomic add to a
+ * shared counter, which is costly when many threads hammer lists at once.
  *
+ * Each operation is counted, and sampled or not, once: macros built from
+ * other list macros (SLIST_REMOVE, the HTABLE family) bracket the inner
+ * ones with QMD_NEST_BEGIN() and QMD_NEST_END(), which makes them follow
+ * the outer decision.
  */
+#if defined(QUEUE_MACRO_DEBUG) || defined(QUEUE_MACRO_DEBUG_COUNTERS)
+#ifndef QUEUE_MACRO_DEBUG_SAMPLE
+#define	QUEUE_MACRO_DEBUG_SAMPLE	1
+#endif
+
+#define	QMD_OPS(X)							\
+	X(SLIST_INSERT_AFTER)						\
+	X(SLIST_INSERT_HEAD)						\
+	X(SLIST_REMOVE)							\
+	X(SLIST_REMOVE_AFTER)						\
+	X(SLIST_REMOVE_HEAD)						\
+	X(SLIST_REVERSE)						\
+	X(SLIST_SORT)							\
+	X(SLIST_SWAP)							\
+	X(STAILQ_CONCAT)						\
+	X(STAILQ_INSERT_AFTER)						\
+	X(STAILQ_INSERT_HEAD)						\
+	X(STAILQ_INSERT_TAIL)						\
+	X(STAILQ_REMOVE)						\
+	X(STAILQ_REMOVE_AFTER)						\
+	X(STAILQ_REMOVE_HEAD)						\
+	X(STAILQ_SORT)							\
+	X(STAILQ_SWAP)							\
+	X(DLIST_CONCAT)							\
+	X(DLIST_INSERT_AFTER)						\
+	X(DLIST_INSERT_BEFORE)						\
+	X(DLIST_INSERT_HEAD)						\
+	X(DLIST_REMOVE)							\
+	X(DLIST_SWAP)							\
+	X(TAILQ_CONCAT)							\
+	X(TAILQ_INSERT_AFTER)						\
+	X(TAILQ_INSERT_BEFORE)						\
+	X(TAILQ_INSERT_HEAD)						\
+	X(TAILQ_INSERT_TAIL)						\
+	X(TAILQ_REMOVE)							\
+	X(TAILQ_SORT)							\
+	X(TAILQ_SPLICE)							\
+	X(TAILQ_SPLICE_AFTER)						\
+	X(TAILQ_SPLIT_AFTER)						\
+	X(TAILQ_SWAP)							\
+	X(HTABLE_INSERT)						\
+	X(HTABLE_MIGRATE)						\
+	X(HTABLE_REMOVE)						\
+	X(HTABLE_RESIZE)
+
+#define	QMD_OP_ENUM(name)	QMD_OP_##name,
+#define	QMD_OP_NAME(name)	#name,
+
+enum {
+	QMD_OPS(QMD_OP_ENUM)
+	QMD_OP_COUNT
+};
+
+#ifdef QUEUE_MACRO_DEBUG_COUNTERS
+extern unsigned long qmd_op_counts[QMD_OP_COUNT];
+extern const char * const qmd_op_names[QMD_OP_COUNT];
+
+#define	QUEUE_MACRO_DEBUG_COUNTERS_DEFINE				\
+	unsigned long qmd_op_counts[QMD_OP_COUNT];			\
+	const char * const qmd_op_names[QMD_OP_COUNT] = {		\
+		QMD_OPS(QMD_OP_NAME)					\
+	}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define	QMD_COUNT_ADD(op, n)						\
+	(void)__atomic_fetch_add(&qmd_op_counts[(op)], (n), __ATOMIC_RELAXED)
+#else
+#define	QMD_COUNT_ADD(op, n)	((void)(qmd_op_counts[(op)] += (n)))
+#endif
+#endif /* QUEUE_MACRO_DEBUG_COUNTERS */
+
+#if QUEUE_MACRO_DEBUG_SAMPLE > 1 || defined(QUEUE_MACRO_DEBUG_COUNTERS)
+/* List macros running inside another one's operation. */
+static _Thread_local unsigned qmd_depth;
+
+#define	QMD_NEST_BEGIN()	(qmd_depth++)
+#define	QMD_NEST_END()		(qmd_depth--)
+#else
+#define	QMD_NEST_BEGIN()
+#define	QMD_NEST_END()
+#endif
+
+#if QUEUE_MACRO_DEBUG_SAMPLE > 1
+static _Thread_local unsigned qmd_countdown = 1;
+static _Thread_local int qmd_sampled;
+#ifdef QUEUE_MACRO_DEBUG_COUNTERS
+static _Thread_local unsigned long qmd_op_pending[QMD_OP_COUNT];
+#endif
+
+/* Counts op, and decides whether this thread samples it. */
+static __inline __unused void
+qmd_op(int op)
+{
+#ifdef QUEUE_MACRO_DEBUG_COUNTERS
+	int index;
+#endif
+
+	if (qmd_depth != 0)
+		return;
+#ifdef QUEUE_MACRO_DEBUG_COUNTERS
+	qmd_op_pending[op]++;
+#else
+	(void)op;
+#endif
+	if (__predict_true(--qmd_countdown != 0)) {
+		qmd_sampled = 0;
+		return;
+	}
+	qmd_countdown = QUEUE_MACRO_DEBUG_SAMPLE;
+	qmd_sampled = 1;
+#ifdef QUEUE_MACRO_DEBUG_COUNTERS
+	for (index = 0; index < QMD_OP_COUNT; index++) {
+		if (qmd_op_pending[index] != 0) {
+			QMD_COUNT_ADD(index, qmd_op_pending[index]);
+			qmd_op_pending[index] = 0;
+		}
+	}
+#endif
+}
+
+#define	QMD_OP(name)	qmd_op(QMD_OP_##name)
+#define	QMD_SAMPLED()	(qmd_sampled)
+#else
+#ifdef QUEUE_MACRO_DEBUG_COUNTERS
+#define	QMD_OP(name)							\
+	(qmd_depth == 0 ? QMD_COUNT_ADD(QMD_OP_##name, 1) : (void)0)
+#else
+#define	QMD_OP(name)
+#endif
+#define	QMD_SAMPLED()	1
+#endif /* QUEUE_MACRO_DEBUG_SAMPLE > 1 */
+#else
+#define	QMD_OP(name)
+#define	QMD_NEST_BEGIN()
+#define	QMD_NEST_END()
+#endif /* QUEUE_MACRO_DEBUG || QUEUE_MACRO_DEBUG_COUNTERS */
+
 #ifdef QUEUE_MACRO_DEBUG
 /* Store the last 2 places the queue element or head was altered */
 struct qm_trace {
@@ -134,9 +341,11 @@ struct qm_trace {
 #define	TRACEBUF	struct qm_trace trace;
 #define	TRACEBUF_INITIALIZER	{ __LINE__, 0, __FILE__, NULL } ,
 #define	TRASHIT(x)	MULTI_LINE_MACRO_BEGIN(x) = (void *)-1;MULTI_LINE_MACRO_END
-#define	QMD_SAVELINK(name, link)	void **name = (void *)&(link)
+#define	QMD_SAVELINK(name, link)	void **name = (void **)(void *)&(link)
 
 #define	QMD_TRACE_HEAD(head) MULTI_LINE_MACRO_BEGIN					\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	(head)->trace.prevline = (head)->trace.lastline;		\
 	(head)->trace.prevfile = (head)->trace.lastfile;		\
 	(head)->trace.lastline = __LINE__;				\
@@ -144,6 +353,8 @@ struct qm_trace {
 MULTI_LINE_MACRO_END
 
 #define	QMD_TRACE_ELEM(elem) MULTI_LINE_MACRO_BEGIN					\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	(elem)->trace.prevline = (elem)->trace.lastline;		\
 	(elem)->trace.prevfile = (elem)->trace.lastfile;		\
 	(elem)->trace.lastline = __LINE__;				\
@@ -159,6 +370,22 @@ MULTI_LINE_MACRO_END
 #define	TRASHIT(x)
 #endif	/* QUEUE_MACRO_DEBUG */
 
+#ifndef QMD_SAMPLED
+#define	QMD_SAMPLED()	1
+#endif
+
+#ifdef _KERNEL
+#define	QMD_PANIC	panic
+#elif defined(QUEUE_MACRO_DEBUG)
+#include <stdio.h>
+#include <stdlib.h>
+#define	QMD_PANIC(...) MULTI_LINE_MACRO_BEGIN				\
+	fprintf(stderr, __VA_ARGS__);					\
+	fputc('\n', stderr);						\
+	abort();							\
+MULTI_LINE_MACRO_END
+#endif /* _KERNEL */
+
 #ifdef __cplusplus
 /*
  * In C++ there can be structure lists and class lists:
@@ -168,6 +395,110 @@ MULTI_LINE_MACRO_END
 #define	QUEUE_TYPEOF(type) struct type
 #endif
 
+/*
+ * Prefetching traversal.
+ *
+ * The _FOREACH_PREFETCH variants walk a second cursor, ahead, a void
+ * pointer supplied by the caller, QUEUE_PREFETCH_DISTANCE elements in front
+ * of var, and prefetch each element's link as ahead reaches it. The cursor
+ * still has to load each link before it can take the next hop, but that
+ * load waits on a line requested one iteration earlier, so the miss
+ * overlaps the previous loop body instead of following it. Long bodies
+ * over scattered elements gain most; a body that only sums a field gains
+ * nothing, as the processor already overlaps that much by itself. The
+ * distance is how many iterations before var reaches an element its line
+ * was requested; define QUEUE_PREFETCH_DISTANCE before including this file
+ * to change it. The loop body must not remove elements. Without GCC/clang
+ * __builtin_prefetch they behave as _FOREACH.
+ */
+#ifndef QUEUE_PREFETCH_DISTANCE
+#define	QUEUE_PREFETCH_DISTANCE	4
+#endif
+
+/* Byte offset of the link lvalue within the element it belongs to. */
+#define	QUEUE_LINK_OFFSET(elm, link)					\
+	((size_t)((char *)&(link) - (char *)(elm)))
+
+#if defined(__GNUC__) || defined(__clang__)
+#define	QUEUE_PREFETCH(addr)	__builtin_prefetch((addr), 0, 3)
+
+typedef void *queue_link_t __attribute__((__may_alias__));
+
+/* Follows hops links from elm, prefetching each link reached. */
+static __inline __unused void *
+queue_prefetch_ahead(void *elm, size_t linkoff, int hops)
+{
+	while (elm != NULL && hops-- > 0) {
+		elm = *(queue_link_t *)((char *)elm + linkoff);
+		if (elm != NULL)
+			QUEUE_PREFETCH((char *)elm + linkoff);
+	}
+	return (elm);
+}
+#else
+#define	QUEUE_PREFETCH(addr)	((void)0)
+#define	queue_prefetch_ahead(elm, linkoff, hops)	((void *)0)
+#endif /* __GNUC__ || __clang__ */
+
+/* link is the expression, in var, for the element after var. */
+#define	QUEUE_FOREACH_PREFETCH(var, first, link, ahead)			\
+	for ((var) = (first),						\
+	    (ahead) = (var) ? queue_prefetch_ahead((var),		\
+	    QUEUE_LINK_OFFSET((var), (link)), QUEUE_PREFETCH_DISTANCE) : NULL;\
+	    (var);							\
+	    (ahead) = queue_prefetch_ahead((ahead),			\
+	    QUEUE_LINK_OFFSET((var), (link)), 1),			\
+	    (var) = (link))
+
+/*
+ * Stable bottom-up merge sort of the NULL-terminated chain starting at the
+ * lvalue first, linked through elm->link. Runs of 1, 2, 4, ... elements are
+ * merged in place, so nothing is allocated. Leaves first pointing at the
+ * lowest element and sorttail at the highest, or NULL if empty. cmp(a, b)
+ * returns a negative value if a sorts before b, as for RB trees; elements
+ * comparing equal keep their order.
+ */
+#define	QUEUE_MERGESORT(first, sorttail, type, link, cmp) MULTI_LINE_MACRO_BEGIN\
+	QUEUE_TYPEOF(type) *ms_p, *ms_q, *ms_elm;			\
+	size_t ms_run = 1, ms_merges, ms_psize, ms_qsize;		\
+	(sorttail) = NULL;						\
+	while ((first) != NULL) {					\
+		ms_p = (first);						\
+		(first) = (sorttail) = NULL;				\
+		ms_merges = 0;						\
+		while (ms_p != NULL) {					\
+			ms_merges++;					\
+			ms_q = ms_p;					\
+			for (ms_psize = 0; ms_psize < ms_run && ms_q != NULL;\
+			    ms_psize++)					\
+				ms_q = ms_q->link;			\
+			ms_qsize = ms_run;				\
+			while (ms_psize > 0 || (ms_qsize > 0 && ms_q != NULL)) {\
+				if (ms_psize > 0 && (ms_qsize == 0 ||	\
+				    ms_q == NULL || (cmp)(ms_p, ms_q) <= 0)) {\
+					ms_elm = ms_p;			\
+					ms_p = ms_p->link;		\
+					ms_psize--;			\
+				} else {				\
+					ms_elm = ms_q;			\
+					ms_q = ms_q->link;		\
+					ms_qsize--;			\
+				}					\
+				if ((sorttail) != NULL)			\
+					(sorttail)->link = ms_elm;	\
+				else					\
+					(first) = ms_elm;		\
+				(sorttail) = ms_elm;			\
+			}						\
+			ms_p = ms_q;					\
+		}							\
+		(sorttail)->link = NULL;				\
+		if (ms_merges <= 1)					\
+			break;						\
+		ms_run *= 2;						\
+	}								\
+MULTI_LINE_MACRO_END
+
 /*
  * Singly-linked List declarations.
  */
@@ -221,6 +552,10 @@ struct {								\
 	    (var) && ((tvar) = SLIST_NEXT((var), field), 1);		\
 	    (var) = (tvar))
 
+#define	SLIST_FOREACH_PREFETCH(var, head, field, ahead)			\
+	QUEUE_FOREACH_PREFETCH(var, SLIST_FIRST((head)),		\
+	    SLIST_NEXT((var), field), ahead)
+
 #define	SLIST_FOREACH_PREVPTR(var, varp, head, field)			\
 	for ((varp) = &SLIST_FIRST((head));				\
 	    ((var) = *(varp)) != NULL;					\
@@ -231,11 +566,13 @@ struct {								\
 MULTI_LINE_MACRO_END
 
 #define	SLIST_INSERT_AFTER(slistelm, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(SLIST_INSERT_AFTER);					\
 	SLIST_NEXT((elm), field) = SLIST_NEXT((slistelm), field);	\
 	SLIST_NEXT((slistelm), field) = (elm);				\
 MULTI_LINE_MACRO_END
 
 #define	SLIST_INSERT_HEAD(head, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(SLIST_INSERT_HEAD);					\
 	SLIST_NEXT((elm), field) = SLIST_FIRST((head));			\
 	SLIST_FIRST((head)) = (elm);					\
 MULTI_LINE_MACRO_END
@@ -243,6 +580,8 @@ MULTI_LINE_MACRO_END
 #define	SLIST_NEXT(elm, field)	((elm)->field.sle_next)
 
 #define	SLIST_REMOVE(head, elm, type, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(SLIST_REMOVE);						\
+	QMD_NEST_BEGIN();						\
 	QMD_SAVELINK(oldnext, (elm)->field.sle_next);			\
 	if (SLIST_FIRST((head)) == (elm)) {				\
 		SLIST_REMOVE_HEAD((head), field);			\
@@ -253,19 +592,43 @@ MULTI_LINE_MACRO_END
 			curelm = SLIST_NEXT(curelm, field);		\
 		SLIST_REMOVE_AFTER(curelm, field);			\
 	}								\
+	QMD_NEST_END();							\
 	TRASHIT(*oldnext);						\
 MULTI_LINE_MACRO_END
 
 #define SLIST_REMOVE_AFTER(elm, field) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(SLIST_REMOVE_AFTER);					\
 	SLIST_NEXT(elm, field) =					\
 	    SLIST_NEXT(SLIST_NEXT(elm, field), field);			\
 MULTI_LINE_MACRO_END
 
 #define	SLIST_REMOVE_HEAD(head, field) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(SLIST_REMOVE_HEAD);					\
 	SLIST_FIRST((head)) = SLIST_NEXT(SLIST_FIRST((head)), field);	\
 MULTI_LINE_MACRO_END
 
+#define	SLIST_REVERSE(head, type, field) MULTI_LINE_MACRO_BEGIN		\
+	QMD_OP(SLIST_REVERSE);						\
+	QUEUE_TYPEOF(type) *rev_prev = NULL, *rev_next;			\
+	QUEUE_TYPEOF(type) *rev_elm = SLIST_FIRST((head));		\
+	while (rev_elm != NULL) {					\
+		rev_next = SLIST_NEXT(rev_elm, field);			\
+		SLIST_NEXT(rev_elm, field) = rev_prev;			\
+		rev_prev = rev_elm;					\
+		rev_elm = rev_next;					\
+	}								\
+	SLIST_FIRST((head)) = rev_prev;					\
+MULTI_LINE_MACRO_END
+
+#define	SLIST_SORT(head, type, field, cmp) MULTI_LINE_MACRO_BEGIN	\
+	QMD_OP(SLIST_SORT);						\
+	QUEUE_TYPEOF(type) *sort_tail;					\
+	QUEUE_MERGESORT(SLIST_FIRST((head)), sort_tail, type,		\
+	    field.sle_next, cmp);					\
+MULTI_LINE_MACRO_END
+
 #define SLIST_SWAP(head1, head2, type) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(SLIST_SWAP);						\
 	QUEUE_TYPEOF(type) *swap_first = SLIST_FIRST(head1);		\
 	SLIST_FIRST(head1) = SLIST_FIRST(head2);			\
 	SLIST_FIRST(head2) = swap_first;				\
@@ -303,6 +666,7 @@ struct {								\
  * Singly-linked Tail queue functions.
  */
 #define	STAILQ_CONCAT(head1, head2) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(STAILQ_CONCAT);						\
 	if (!STAILQ_EMPTY((head2))) {					\
 		*(head1)->stqh_last = (head2)->stqh_first;		\
 		(head1)->stqh_last = (head2)->stqh_last;		\
@@ -334,24 +698,31 @@ MULTI_LINE_MACRO_END
 	    (var) && ((tvar) = STAILQ_NEXT((var), field), 1);		\
 	    (var) = (tvar))
 
+#define	STAILQ_FOREACH_PREFETCH(var, head, field, ahead)		\
+	QUEUE_FOREACH_PREFETCH(var, STAILQ_FIRST((head)),		\
+	    STAILQ_NEXT((var), field), ahead)
+
 #define	STAILQ_INIT(head) MULTI_LINE_MACRO_BEGIN						\
 	STAILQ_FIRST((head)) = NULL;					\
 	(head)->stqh_last = &STAILQ_FIRST((head));			\
 MULTI_LINE_MACRO_END
 
 #define	STAILQ_INSERT_AFTER(head, tqelm, elm, field) MULTI_LINE_MACRO_BEGIN		\
+	QMD_OP(STAILQ_INSERT_AFTER);					\
 	if ((STAILQ_NEXT((elm), field) = STAILQ_NEXT((tqelm), field)) == NULL)\
 		(head)->stqh_last = &STAILQ_NEXT((elm), field);		\
 	STAILQ_NEXT((tqelm), field) = (elm);				\
 MULTI_LINE_MACRO_END
 
 #define	STAILQ_INSERT_HEAD(head, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(STAILQ_INSERT_HEAD);					\
 	if ((STAILQ_NEXT((elm), field) = STAILQ_FIRST((head))) == NULL)	\
 		(head)->stqh_last = &STAILQ_NEXT((elm), field);		\
 	STAILQ_FIRST((head)) = (elm);					\
 MULTI_LINE_MACRO_END
 
 #define	STAILQ_INSERT_TAIL(head, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(STAILQ_INSERT_TAIL);					\
 	STAILQ_NEXT((elm), field) = NULL;				\
 	*(head)->stqh_last = (elm);					\
 	(head)->stqh_last = &STAILQ_NEXT((elm), field);			\
@@ -365,6 +736,8 @@ MULTI_LINE_MACRO_END
 #define	STAILQ_NEXT(elm, field)	((elm)->field.stqe_next)
 
 #define	STAILQ_REMOVE(head, elm, type, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(STAILQ_REMOVE);						\
+	QMD_NEST_BEGIN();						\
 	QMD_SAVELINK(oldnext, (elm)->field.stqe_next);			\
 	if (STAILQ_FIRST((head)) == (elm)) {				\
 		STAILQ_REMOVE_HEAD((head), field);			\
@@ -375,22 +748,35 @@ MULTI_LINE_MACRO_END
 			curelm = STAILQ_NEXT(curelm, field);		\
 		STAILQ_REMOVE_AFTER(head, curelm, field);		\
 	}								\
+	QMD_NEST_END();							\
 	TRASHIT(*oldnext);						\
 MULTI_LINE_MACRO_END
 
 #define STAILQ_REMOVE_AFTER(head, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(STAILQ_REMOVE_AFTER);					\
 	if ((STAILQ_NEXT(elm, field) =					\
 	     STAILQ_NEXT(STAILQ_NEXT(elm, field), field)) == NULL)	\
 		(head)->stqh_last = &STAILQ_NEXT((elm), field);		\
 MULTI_LINE_MACRO_END
 
 #define	STAILQ_REMOVE_HEAD(head, field) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(STAILQ_REMOVE_HEAD);					\
 	if ((STAILQ_FIRST((head)) =					\
 	     STAILQ_NEXT(STAILQ_FIRST((head)), field)) == NULL)		\
 		(head)->stqh_last = &STAILQ_FIRST((head));		\
 MULTI_LINE_MACRO_END
 
+#define	STAILQ_SORT(head, type, field, cmp) MULTI_LINE_MACRO_BEGIN	\
+	QMD_OP(STAILQ_SORT);						\
+	QUEUE_TYPEOF(type) *sort_tail;					\
+	QUEUE_MERGESORT(STAILQ_FIRST((head)), sort_tail, type,		\
+	    field.stqe_next, cmp);					\
+	(head)->stqh_last = sort_tail != NULL ?				\
+	    &STAILQ_NEXT(sort_tail, field) : &STAILQ_FIRST((head));	\
+MULTI_LINE_MACRO_END
+
 #define STAILQ_SWAP(head1, head2, type) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(STAILQ_SWAP);						\
 	QUEUE_TYPEOF(type) *swap_first = STAILQ_FIRST(head1);		\
 	QUEUE_TYPEOF(type) **swap_last = (head1)->stqh_last;		\
 	STAILQ_FIRST(head1) = STAILQ_FIRST(head2);			\
@@ -436,30 +822,56 @@ struct {								\
  * List functions.
  */
 
-#if (defined(_KERNEL) && defined(INVARIANTS))
+#if (defined(_KERNEL) && defined(INVARIANTS)) || defined(QUEUE_MACRO_DEBUG)
 #define	QMD_DLIST_CHECK_HEAD(head, field) MULTI_LINE_MACRO_BEGIN				\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	if (DLIST_FIRST((head)) != NULL &&				\
 	    DLIST_FIRST((head))->field.le_prev !=			\
 	     &DLIST_FIRST((head)))					\
-		panic("Bad list head %p first->prev != head", (head));	\
+		QMD_PANIC("Bad list head %p first->prev != head", (head));	\
 MULTI_LINE_MACRO_END
 
 #define	QMD_DLIST_CHECK_NEXT(elm, field) MULTI_LINE_MACRO_BEGIN				\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	if (DLIST_NEXT((elm), field) != NULL &&				\
 	    DLIST_NEXT((elm), field)->field.le_prev !=			\
 	     &((elm)->field.le_next))					\
-	     	panic("Bad link elm %p next->prev != elm", (elm));	\
+	     	QMD_PANIC("Bad link elm %p next->prev != elm", (elm));	\
 MULTI_LINE_MACRO_END
 
 #define	QMD_DLIST_CHECK_PREV(elm, field) MULTI_LINE_MACRO_BEGIN				\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	if (*(elm)->field.le_prev != (elm))				\
-		panic("Bad link elm %p prev->next != elm", (elm));	\
+		QMD_PANIC("Bad link elm %p prev->next != elm", (elm));	\
 MULTI_LINE_MACRO_END
 #else
 #define	QMD_DLIST_CHECK_HEAD(head, field)
 #define	QMD_DLIST_CHECK_NEXT(elm, field)
 #define	QMD_DLIST_CHECK_PREV(elm, field)
-#endif /* (_KERNEL && INVARIANTS) */
+#endif /* (_KERNEL && INVARIANTS) || QUEUE_MACRO_DEBUG */
+
+/* Walks head1 to find its end: O(n) in the length of head1. */
+#define	DLIST_CONCAT(head1, head2, type, field) MULTI_LINE_MACRO_BEGIN	\
+	QMD_OP(DLIST_CONCAT);						\
+	QUEUE_TYPEOF(type) *curelm = DLIST_FIRST((head1));		\
+	if (curelm == NULL) {						\
+		if ((DLIST_FIRST((head1)) = DLIST_FIRST((head2))) != NULL) {\
+			DLIST_FIRST((head2))->field.le_prev =		\
+			    &DLIST_FIRST((head1));			\
+			DLIST_INIT((head2));				\
+		}							\
+	} else if (DLIST_FIRST((head2)) != NULL) {			\
+		while (DLIST_NEXT(curelm, field) != NULL)		\
+			curelm = DLIST_NEXT(curelm, field);		\
+		DLIST_NEXT(curelm, field) = DLIST_FIRST((head2));	\
+		DLIST_FIRST((head2))->field.le_prev =			\
+		    &DLIST_NEXT(curelm, field);				\
+		DLIST_INIT((head2));					\
+	}								\
+MULTI_LINE_MACRO_END
 
 #define	DLIST_EMPTY(head)	((head)->lh_first == NULL)
 
@@ -485,11 +897,16 @@ MULTI_LINE_MACRO_END
 	    (var) && ((tvar) = DLIST_NEXT((var), field), 1);		\
 	    (var) = (tvar))
 
+#define	DLIST_FOREACH_PREFETCH(var, head, field, ahead)			\
+	QUEUE_FOREACH_PREFETCH(var, DLIST_FIRST((head)),		\
+	    DLIST_NEXT((var), field), ahead)
+
 #define	DLIST_INIT(head) MULTI_LINE_MACRO_BEGIN						\
 	DLIST_FIRST((head)) = NULL;					\
 MULTI_LINE_MACRO_END
 
 #define	DLIST_INSERT_AFTER(listelm, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(DLIST_INSERT_AFTER);					\
 	QMD_DLIST_CHECK_NEXT(listelm, field);				\
 	if ((DLIST_NEXT((elm), field) = DLIST_NEXT((listelm), field)) != NULL)\
 		DLIST_NEXT((listelm), field)->field.le_prev =		\
@@ -499,6 +916,7 @@ MULTI_LINE_MACRO_END
 MULTI_LINE_MACRO_END
 
 #define	DLIST_INSERT_BEFORE(listelm, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(DLIST_INSERT_BEFORE);					\
 	QMD_DLIST_CHECK_PREV(listelm, field);				\
 	(elm)->field.le_prev = (listelm)->field.le_prev;		\
 	DLIST_NEXT((elm), field) = (listelm);				\
@@ -507,6 +925,7 @@ MULTI_LINE_MACRO_END
 MULTI_LINE_MACRO_END
 
 #define	DLIST_INSERT_HEAD(head, elm, field) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(DLIST_INSERT_HEAD);					\
 	QMD_DLIST_CHECK_HEAD((head), field);				\
 	if ((DLIST_NEXT((elm), field) = DLIST_FIRST((head))) != NULL)	\
 		DLIST_FIRST((head))->field.le_prev = &DLIST_NEXT((elm), field);\
@@ -522,6 +941,7 @@ MULTI_LINE_MACRO_END
 	    QUEUE_TYPEOF(type), field.le_next))
 
 #define	DLIST_REMOVE(elm, field) MULTI_LINE_MACRO_BEGIN					\
+	QMD_OP(DLIST_REMOVE);						\
 	QMD_SAVELINK(oldnext, (elm)->field.le_next);			\
 	QMD_SAVELINK(oldprev, (elm)->field.le_prev);			\
 	QMD_DLIST_CHECK_NEXT(elm, field);				\
@@ -535,6 +955,7 @@ MULTI_LINE_MACRO_END
 MULTI_LINE_MACRO_END
 
 #define DLIST_SWAP(head1, head2, type, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(DLIST_SWAP);						\
 	QUEUE_TYPEOF(type) *swap_tmp = DLIST_FIRST(head1);		\
 	DLIST_FIRST((head1)) = DLIST_FIRST((head2));			\
 	DLIST_FIRST((head2)) = swap_tmp;					\
@@ -581,38 +1002,47 @@ struct {								\
 /*
  * Tail queue functions.
  */
-#if (defined(_KERNEL) && defined(INVARIANTS))
+#if (defined(_KERNEL) && defined(INVARIANTS)) || defined(QUEUE_MACRO_DEBUG)
 #define	QMD_TAILQ_CHECK_HEAD(head, field) MULTI_LINE_MACRO_BEGIN				\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	if (!TAILQ_EMPTY(head) &&					\
 	    TAILQ_FIRST((head))->field.tqe_prev !=			\
 	     &TAILQ_FIRST((head)))					\
-		panic("Bad tailq head %p first->prev != head", (head));	\
+		QMD_PANIC("Bad tailq head %p first->prev != head", (head));	\
 MULTI_LINE_MACRO_END
 
 #define	QMD_TAILQ_CHECK_TAIL(head, field) MULTI_LINE_MACRO_BEGIN				\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	if (*(head)->tqh_last != NULL)					\
-	    	panic("Bad tailq NEXT(%p->tqh_last) != NULL", (head)); 	\
+	    	QMD_PANIC("Bad tailq NEXT(%p->tqh_last) != NULL", (head)); 	\
 MULTI_LINE_MACRO_END
 
 #define	QMD_TAILQ_CHECK_NEXT(elm, field) MULTI_LINE_MACRO_BEGIN				\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	if (TAILQ_NEXT((elm), field) != NULL &&				\
 	    TAILQ_NEXT((elm), field)->field.tqe_prev !=			\
 	     &((elm)->field.tqe_next))					\
-		panic("Bad link elm %p next->prev != elm", (elm));	\
+		QMD_PANIC("Bad link elm %p next->prev != elm", (elm));	\
 MULTI_LINE_MACRO_END
 
 #define	QMD_TAILQ_CHECK_PREV(elm, field) MULTI_LINE_MACRO_BEGIN				\
+	if (!QMD_SAMPLED())						\
+		break;							\
 	if (*(elm)->field.tqe_prev != (elm))				\
-		panic("Bad link elm %p prev->next != elm", (elm));	\
+		QMD_PANIC("Bad link elm %p prev->next != elm", (elm));	\
 MULTI_LINE_MACRO_END
 #else
 #define	QMD_TAILQ_CHECK_HEAD(head, field)
 #define	QMD_TAILQ_CHECK_TAIL(head, headname)
 #define	QMD_TAILQ_CHECK_NEXT(elm, field)
 #define	QMD_TAILQ_CHECK_PREV(elm, field)
-#endif /* (_KERNEL && INVARIANTS) */
+#endif /* (_KERNEL && INVARIANTS) || QUEUE_MACRO_DEBUG */
 
 #define	TAILQ_CONCAT(head1, head2, field) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(TAILQ_CONCAT);						\
 	if (!TAILQ_EMPTY(head2)) {					\
 		*(head1)->tqh_last = (head2)->tqh_first;		\
 		(head2)->tqh_first->field.tqe_prev = (head1)->tqh_last;	\
@@ -647,6 +1077,10 @@ MULTI_LINE_MACRO_END
 	    (var) && ((tvar) = TAILQ_NEXT((var), field), 1);		\
 	    (var) = (tvar))
 
+#define	TAILQ_FOREACH_PREFETCH(var, head, field, ahead)			\
+	QUEUE_FOREACH_PREFETCH(var, TAILQ_FIRST((head)),		\
+	    TAILQ_NEXT((var), field), ahead)
+
 #define	TAILQ_FOREACH_REVERSE(var, head, headname, field)		\
 	for ((var) = TAILQ_LAST((head), headname);			\
 	    (var);							\
@@ -674,6 +1108,7 @@ MULTI_LINE_MACRO_END
 MULTI_LINE_MACRO_END
 
 #define	TAILQ_INSERT_AFTER(head, listelm, elm, field) MULTI_LINE_MACRO_BEGIN		\
+	QMD_OP(TAILQ_INSERT_AFTER);					\
 	QMD_TAILQ_CHECK_NEXT(listelm, field);				\
 	if ((TAILQ_NEXT((elm), field) = TAILQ_NEXT((listelm), field)) != NULL)\
 		TAILQ_NEXT((elm), field)->field.tqe_prev = 		\
@@ -689,6 +1124,7 @@ MULTI_LINE_MACRO_END
 MULTI_LINE_MACRO_END
 
 #define	TAILQ_INSERT_BEFORE(listelm, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(TAILQ_INSERT_BEFORE);					\
 	QMD_TAILQ_CHECK_PREV(listelm, field);				\
 	(elm)->field.tqe_prev = (listelm)->field.tqe_prev;		\
 	TAILQ_NEXT((elm), field) = (listelm);				\
@@ -699,6 +1135,7 @@ MULTI_LINE_MACRO_END
 MULTI_LINE_MACRO_END
 
 #define	TAILQ_INSERT_HEAD(head, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(TAILQ_INSERT_HEAD);					\
 	QMD_TAILQ_CHECK_HEAD(head, field);				\
 	if ((TAILQ_NEXT((elm), field) = TAILQ_FIRST((head))) != NULL)	\
 		TAILQ_FIRST((head))->field.tqe_prev =			\
@@ -712,6 +1149,7 @@ MULTI_LINE_MACRO_END
 MULTI_LINE_MACRO_END
 
 #define	TAILQ_INSERT_TAIL(head, elm, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(TAILQ_INSERT_TAIL);					\
 	QMD_TAILQ_CHECK_TAIL(head, field);				\
 	TAILQ_NEXT((elm), field) = NULL;				\
 	(elm)->field.tqe_prev = (head)->tqh_last;			\
@@ -730,6 +1168,7 @@ MULTI_LINE_MACRO_END
 	(*(((struct headname *)((elm)->field.tqe_prev))->tqh_last))
 
 #define	TAILQ_REMOVE(head, elm, field) MULTI_LINE_MACRO_BEGIN				\
+	QMD_OP(TAILQ_REMOVE);						\
 	QMD_SAVELINK(oldnext, (elm)->field.tqe_next);			\
 	QMD_SAVELINK(oldprev, (elm)->field.tqe_prev);			\
 	QMD_TAILQ_CHECK_NEXT(elm, field);				\
@@ -747,6 +1186,83 @@ MULTI_LINE_MACRO_END
 	QMD_TRACE_ELEM(&(elm)->field);					\
 MULTI_LINE_MACRO_END
 
+#define	TAILQ_SORT(head, type, field, cmp) MULTI_LINE_MACRO_BEGIN	\
+	QMD_OP(TAILQ_SORT);						\
+	QUEUE_TYPEOF(type) *sort_tail, *sort_elm;			\
+	QUEUE_TYPEOF(type) **sort_prevp = &TAILQ_FIRST((head));		\
+	QUEUE_MERGESORT(TAILQ_FIRST((head)), sort_tail, type,		\
+	    field.tqe_next, cmp);					\
+	for (sort_elm = TAILQ_FIRST((head)); sort_elm != NULL;		\
+	    sort_elm = TAILQ_NEXT(sort_elm, field)) {			\
+		sort_elm->field.tqe_prev = sort_prevp;			\
+		sort_prevp = &TAILQ_NEXT(sort_elm, field);		\
+	}								\
+	(head)->tqh_last = sort_prevp;					\
+	QMD_TRACE_HEAD(head);						\
+MULTI_LINE_MACRO_END
+
+/* Cuts first through last, in that order, out of head. */
+#define	TAILQ_UNLINK_RANGE(head, first, last, field) MULTI_LINE_MACRO_BEGIN\
+	if (TAILQ_NEXT((last), field) != NULL)				\
+		TAILQ_NEXT((last), field)->field.tqe_prev =		\
+		    (first)->field.tqe_prev;				\
+	else								\
+		(head)->tqh_last = (first)->field.tqe_prev;		\
+	*(first)->field.tqe_prev = TAILQ_NEXT((last), field);		\
+	QMD_TRACE_HEAD(head);						\
+MULTI_LINE_MACRO_END
+
+/*
+ * Moves first through last from head2 to the end of head1 in O(1). first
+ * and last are read once, so may be expressions over head2.
+ */
+#define	TAILQ_SPLICE(head1, head2, first, last, type, field) MULTI_LINE_MACRO_BEGIN\
+	QMD_OP(TAILQ_SPLICE);						\
+	QUEUE_TYPEOF(type) *splice_first = (first);			\
+	QUEUE_TYPEOF(type) *splice_last = (last);			\
+	TAILQ_UNLINK_RANGE(head2, splice_first, splice_last, field);	\
+	TAILQ_NEXT(splice_last, field) = NULL;				\
+	splice_first->field.tqe_prev = (head1)->tqh_last;		\
+	*(head1)->tqh_last = splice_first;				\
+	(head1)->tqh_last = &TAILQ_NEXT(splice_last, field);		\
+	QMD_TRACE_HEAD(head1);						\
+MULTI_LINE_MACRO_END
+
+/*
+ * As TAILQ_SPLICE, but inserts after listelm in head1. listelm is also read
+ * once, before head1 changes, so may be e.g. TAILQ_LAST(head1, headname).
+ */
+#define	TAILQ_SPLICE_AFTER(head1, listelm, head2, first, last, type, field) MULTI_LINE_MACRO_BEGIN\
+	QMD_OP(TAILQ_SPLICE_AFTER);					\
+	QUEUE_TYPEOF(type) *splice_after = (listelm);			\
+	QUEUE_TYPEOF(type) *splice_first = (first);			\
+	QUEUE_TYPEOF(type) *splice_last = (last);			\
+	TAILQ_UNLINK_RANGE(head2, splice_first, splice_last, field);	\
+	if ((TAILQ_NEXT(splice_last, field) =				\
+	    TAILQ_NEXT(splice_after, field)) != NULL)			\
+		TAILQ_NEXT(splice_last, field)->field.tqe_prev =	\
+		    &TAILQ_NEXT(splice_last, field);			\
+	else								\
+		(head1)->tqh_last = &TAILQ_NEXT(splice_last, field);	\
+	TAILQ_NEXT(splice_after, field) = splice_first;			\
+	splice_first->field.tqe_prev = &TAILQ_NEXT(splice_after, field);\
+	QMD_TRACE_HEAD(head1);						\
+MULTI_LINE_MACRO_END
+
+/* Moves every element after elm in head1 to head2, replacing its contents. */
+#define	TAILQ_SPLIT_AFTER(head1, elm, head2, field) MULTI_LINE_MACRO_BEGIN\
+	QMD_OP(TAILQ_SPLIT_AFTER);					\
+	if ((TAILQ_FIRST((head2)) = TAILQ_NEXT((elm), field)) != NULL) {\
+		TAILQ_FIRST((head2))->field.tqe_prev = &TAILQ_FIRST((head2));\
+		(head2)->tqh_last = (head1)->tqh_last;			\
+		TAILQ_NEXT((elm), field) = NULL;			\
+		(head1)->tqh_last = &TAILQ_NEXT((elm), field);		\
+	} else								\
+		(head2)->tqh_last = &TAILQ_FIRST((head2));		\
+	QMD_TRACE_HEAD(head1);						\
+	QMD_TRACE_HEAD(head2);						\
+MULTI_LINE_MACRO_END
+
 #define TAILQ_CLEAR( elm, field )	MULTI_LINE_MACRO_BEGIN	\
 	(elm)->field.tqe_next = NULL;	\
 	(elm)->field.tqe_prev = NULL;	\
@@ -756,6 +1272,7 @@ MULTI_LINE_MACRO_END
 	((  (elm)->field.tqe_next == NULL && (elm)->field.tqe_prev == NULL ))
 
 #define TAILQ_SWAP(head1, head2, type, field) MULTI_LINE_MACRO_BEGIN			\
+	QMD_OP(TAILQ_SWAP);						\
 	QUEUE_TYPEOF(type) *swap_first = (head1)->tqh_first;		\
 	QUEUE_TYPEOF(type) **swap_last = (head1)->tqh_last;		\
 	(head1)->tqh_first = (head2)->tqh_first;			\
@@ -772,4 +1289,571 @@ MULTI_LINE_MACRO_END
 		(head2)->tqh_last = &(head2)->tqh_first;		\
 MULTI_LINE_MACRO_END
 
+/*
+ * Typed function generators.
+ *
+ * Emit static inline functions named prefix_FAMILY_OPERATION for lists of
+ * struct type, linked through field, headed by struct name. Each wraps the
+ * macro of the same name, so behaviour, including QUEUE_MACRO_DEBUG
+ * checking, is unchanged.
+ */
+#define	SLIST_GENERATE(prefix, name, type, field)			\
+static __inline __unused void						\
+prefix##_SLIST_INIT(struct name *head)					\
+{									\
+	SLIST_INIT(head);						\
+}									\
+									\
+static __inline __unused int						\
+prefix##_SLIST_EMPTY(const struct name *head)				\
+{									\
+	return (SLIST_EMPTY(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_SLIST_FIRST(const struct name *head)				\
+{									\
+	return (SLIST_FIRST(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_SLIST_NEXT(const QUEUE_TYPEOF(type) *elm)			\
+{									\
+	return (SLIST_NEXT(elm, field));				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_SLIST_INSERT_HEAD(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	SLIST_INSERT_HEAD(head, elm, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_SLIST_INSERT_AFTER(QUEUE_TYPEOF(type) *slistelm,		\
+    QUEUE_TYPEOF(type) *elm)						\
+{									\
+	SLIST_INSERT_AFTER(slistelm, elm, field);			\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_SLIST_REMOVE_HEAD(struct name *head)				\
+{									\
+	QUEUE_TYPEOF(type) *elm = SLIST_FIRST(head);			\
+									\
+	if (elm != NULL)						\
+		SLIST_REMOVE_HEAD(head, field);				\
+	return (elm);							\
+}									\
+									\
+static __inline __unused void						\
+prefix##_SLIST_REMOVE_AFTER(QUEUE_TYPEOF(type) *elm)			\
+{									\
+	SLIST_REMOVE_AFTER(elm, field);					\
+}									\
+									\
+static __inline __unused void						\
+prefix##_SLIST_REMOVE(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	SLIST_REMOVE(head, elm, type, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_SLIST_SWAP(struct name *head1, struct name *head2)		\
+{									\
+	SLIST_SWAP(head1, head2, type);					\
+}
+
+#define	STAILQ_GENERATE(prefix, name, type, field)			\
+static __inline __unused void						\
+prefix##_STAILQ_INIT(struct name *head)					\
+{									\
+	STAILQ_INIT(head);						\
+}									\
+									\
+static __inline __unused int						\
+prefix##_STAILQ_EMPTY(const struct name *head)				\
+{									\
+	return (STAILQ_EMPTY(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_STAILQ_FIRST(const struct name *head)				\
+{									\
+	return (STAILQ_FIRST(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_STAILQ_LAST(const struct name *head)				\
+{									\
+	return (STAILQ_EMPTY(head) ? NULL :				\
+	    QUEUE_CONTAINEROF(head->stqh_last, type, field.stqe_next));	\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_STAILQ_NEXT(const QUEUE_TYPEOF(type) *elm)			\
+{									\
+	return (STAILQ_NEXT(elm, field));				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_STAILQ_INSERT_HEAD(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	STAILQ_INSERT_HEAD(head, elm, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_STAILQ_INSERT_TAIL(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	STAILQ_INSERT_TAIL(head, elm, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_STAILQ_INSERT_AFTER(struct name *head,				\
+    QUEUE_TYPEOF(type) *tqelm, QUEUE_TYPEOF(type) *elm)			\
+{									\
+	STAILQ_INSERT_AFTER(head, tqelm, elm, field);			\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_STAILQ_REMOVE_HEAD(struct name *head)				\
+{									\
+	QUEUE_TYPEOF(type) *elm = STAILQ_FIRST(head);			\
+									\
+	if (elm != NULL)						\
+		STAILQ_REMOVE_HEAD(head, field);			\
+	return (elm);							\
+}									\
+									\
+static __inline __unused void						\
+prefix##_STAILQ_REMOVE_AFTER(struct name *head, QUEUE_TYPEOF(type) *elm)\
+{									\
+	STAILQ_REMOVE_AFTER(head, elm, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_STAILQ_REMOVE(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	STAILQ_REMOVE(head, elm, type, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_STAILQ_CONCAT(struct name *head1, struct name *head2)		\
+{									\
+	STAILQ_CONCAT(head1, head2);					\
+}									\
+									\
+static __inline __unused void						\
+prefix##_STAILQ_SWAP(struct name *head1, struct name *head2)		\
+{									\
+	STAILQ_SWAP(head1, head2, type);				\
+}
+
+#define	DLIST_GENERATE(prefix, name, type, field)			\
+static __inline __unused void						\
+prefix##_DLIST_INIT(struct name *head)					\
+{									\
+	DLIST_INIT(head);						\
+}									\
+									\
+static __inline __unused int						\
+prefix##_DLIST_EMPTY(const struct name *head)				\
+{									\
+	return (DLIST_EMPTY(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_DLIST_FIRST(const struct name *head)				\
+{									\
+	return (DLIST_FIRST(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_DLIST_NEXT(const QUEUE_TYPEOF(type) *elm)			\
+{									\
+	return (DLIST_NEXT(elm, field));				\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_DLIST_PREV(struct name *head, QUEUE_TYPEOF(type) *elm)		\
+{									\
+	return (elm->field.le_prev == &DLIST_FIRST(head) ? NULL :	\
+	    QUEUE_CONTAINEROF(elm->field.le_prev, type, field.le_next));	\
+}									\
+									\
+static __inline __unused void						\
+prefix##_DLIST_INSERT_HEAD(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	DLIST_INSERT_HEAD(head, elm, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_DLIST_INSERT_AFTER(QUEUE_TYPEOF(type) *listelm,		\
+    QUEUE_TYPEOF(type) *elm)						\
+{									\
+	DLIST_INSERT_AFTER(listelm, elm, field);			\
+}									\
+									\
+static __inline __unused void						\
+prefix##_DLIST_INSERT_BEFORE(QUEUE_TYPEOF(type) *listelm,		\
+    QUEUE_TYPEOF(type) *elm)						\
+{									\
+	DLIST_INSERT_BEFORE(listelm, elm, field);			\
+}									\
+									\
+static __inline __unused void						\
+prefix##_DLIST_REMOVE(QUEUE_TYPEOF(type) *elm)				\
+{									\
+	DLIST_REMOVE(elm, field);					\
+}									\
+									\
+static __inline __unused void						\
+prefix##_DLIST_SWAP(struct name *head1, struct name *head2)		\
+{									\
+	DLIST_SWAP(head1, head2, type, field);				\
+}
+
+#define	TAILQ_GENERATE(prefix, name, type, field)			\
+static __inline __unused void						\
+prefix##_TAILQ_INIT(struct name *head)					\
+{									\
+	TAILQ_INIT(head);						\
+}									\
+									\
+static __inline __unused int						\
+prefix##_TAILQ_EMPTY(const struct name *head)				\
+{									\
+	return (TAILQ_EMPTY(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_TAILQ_FIRST(const struct name *head)				\
+{									\
+	return (TAILQ_FIRST(head));					\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_TAILQ_LAST(const struct name *head)				\
+{									\
+	return (TAILQ_LAST(head, name));				\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_TAILQ_NEXT(const QUEUE_TYPEOF(type) *elm)			\
+{									\
+	return (TAILQ_NEXT(elm, field));				\
+}									\
+									\
+static __inline __unused QUEUE_TYPEOF(type) *				\
+prefix##_TAILQ_PREV(const QUEUE_TYPEOF(type) *elm)			\
+{									\
+	return (TAILQ_PREV(elm, name, field));				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_TAILQ_INSERT_HEAD(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	TAILQ_INSERT_HEAD(head, elm, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_TAILQ_INSERT_TAIL(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	TAILQ_INSERT_TAIL(head, elm, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_TAILQ_INSERT_AFTER(struct name *head,				\
+    QUEUE_TYPEOF(type) *listelm, QUEUE_TYPEOF(type) *elm)		\
+{									\
+	TAILQ_INSERT_AFTER(head, listelm, elm, field);			\
+}									\
+									\
+static __inline __unused void						\
+prefix##_TAILQ_INSERT_BEFORE(QUEUE_TYPEOF(type) *listelm,		\
+    QUEUE_TYPEOF(type) *elm)						\
+{									\
+	TAILQ_INSERT_BEFORE(listelm, elm, field);			\
+}									\
+									\
+static __inline __unused void						\
+prefix##_TAILQ_REMOVE(struct name *head, QUEUE_TYPEOF(type) *elm)	\
+{									\
+	TAILQ_REMOVE(head, elm, field);					\
+}									\
+									\
+static __inline __unused void						\
+prefix##_TAILQ_CONCAT(struct name *head1, struct name *head2)		\
+{									\
+	TAILQ_CONCAT(head1, head2, field);				\
+}									\
+									\
+static __inline __unused void						\
+prefix##_TAILQ_SWAP(struct name *head1, struct name *head2)		\
+{									\
+	TAILQ_SWAP(head1, head2, type, field);				\
+}
+
+/*
+ * Hash table declarations.
+ *
+ * Buckets are DLIST heads; struct name##_htbucket is declared alongside the
+ * table head so callers can allocate bucket arrays. hth_old is only set
+ * while a resize is migrating buckets out of it.
+ */
+#define	HTABLE_BUCKET_HEAD(name)	struct name##_htbucket
+
+#define	HTABLE_HEAD(name, type)						\
+DLIST_HEAD(name##_htbucket, type);					\
+struct name {								\
+	HTABLE_BUCKET_HEAD(name) *hth_buckets;	/* current buckets */	\
+	HTABLE_BUCKET_HEAD(name) *hth_old;	/* migrating from */	\
+	size_t hth_mask;		/* bucket count - 1 */		\
+	size_t hth_oldmask;		/* old bucket count - 1 */	\
+	size_t hth_migrated;		/* old buckets moved so far */	\
+	size_t hth_count;		/* elements */			\
+}
+
+#define	HTABLE_ENTRY(type)						\
+struct {								\
+	DLIST_ENTRY(type) hte_link;	/* bucket linkage */		\
+	size_t hte_hash;		/* full hash of the key */	\
+}
+
+/*
+ * Hash table functions.
+ */
+/* Old buckets moved per insert/remove while resizing. */
+#ifndef HTABLE_MIGRATE_STEP
+#define	HTABLE_MIGRATE_STEP	2
+#endif
+
+#define	HTABLE_COUNT(head)	((head)->hth_count)
+
+#define	HTABLE_EMPTY(head)	((head)->hth_count == 0)
+
+#define	HTABLE_SIZE(head)	((head)->hth_mask + 1)
+
+/* True once the load factor passes one element per bucket. */
+#define	HTABLE_NEEDS_GROW(head)	((head)->hth_count > HTABLE_SIZE((head)))
+
+/* The previous bucket array is the caller's again once this is false. */
+#define	HTABLE_RESIZING(head)	((head)->hth_old != NULL)
+
+#define	HTABLE_HASH(elm, field)	((elm)->field.hte_hash)
+
+/* Bucket currently holding hash: unmigrated old buckets win. */
+#define	HTABLE_BUCKET(head, hash)					\
+	(HTABLE_RESIZING((head)) &&					\
+	    ((hash) & (head)->hth_oldmask) >= (head)->hth_migrated ?	\
+	    &(head)->hth_old[(hash) & (head)->hth_oldmask] :		\
+	    &(head)->hth_buckets[(hash) & (head)->hth_mask])
+
+/* Bucket count must be a power of two. */
+#define	HTABLE_INIT(head, buckets, nbuckets) MULTI_LINE_MACRO_BEGIN	\
+	size_t htable_index;						\
+	for (htable_index = 0; htable_index < (nbuckets); htable_index++)\
+		DLIST_INIT(&(buckets)[htable_index]);			\
+	(head)->hth_buckets = (buckets);				\
+	(head)->hth_mask = (nbuckets) - 1;				\
+	(head)->hth_old = NULL;						\
+	(head)->hth_oldmask = 0;					\
+	(head)->hth_migrated = 0;					\
+	(head)->hth_count = 0;						\
+MULTI_LINE_MACRO_END
+
+/* Moves up to nbuckets old buckets into the current array. */
+#define	HTABLE_MIGRATE(head, nbuckets, type, field) MULTI_LINE_MACRO_BEGIN\
+	QMD_OP(HTABLE_MIGRATE);						\
+	QMD_NEST_BEGIN();						\
+	QUEUE_TYPEOF(type) *htable_elm;					\
+	size_t htable_budget = (nbuckets);				\
+	while (HTABLE_RESIZING((head)) && htable_budget-- > 0) {	\
+		while ((htable_elm = DLIST_FIRST(			\
+		    &(head)->hth_old[(head)->hth_migrated])) != NULL) {	\
+			DLIST_REMOVE(htable_elm, field.hte_link);	\
+			DLIST_INSERT_HEAD(&(head)->hth_buckets[		\
+			    HTABLE_HASH(htable_elm, field) & (head)->hth_mask],\
+			    htable_elm, field.hte_link);		\
+		}							\
+		if ((head)->hth_migrated++ == (head)->hth_oldmask) {	\
+			(head)->hth_old = NULL;				\
+			(head)->hth_migrated = 0;			\
+		}							\
+	}								\
+	QMD_NEST_END();							\
+MULTI_LINE_MACRO_END
+
+/*
+ * Switches to a new, power-of-two sized, bucket array. Elements move over
+ * incrementally; a resize that is still migrating is finished first.
+ */
+#define	HTABLE_RESIZE(head, buckets, nbuckets, type, field) MULTI_LINE_MACRO_BEGIN\
+	QMD_OP(HTABLE_RESIZE);						\
+	QMD_NEST_BEGIN();						\
+	size_t htable_index;						\
+	HTABLE_MIGRATE((head), (head)->hth_oldmask + 1, type, field);	\
+	for (htable_index = 0; htable_index < (nbuckets); htable_index++)\
+		DLIST_INIT(&(buckets)[htable_index]);			\
+	(head)->hth_old = (head)->hth_buckets;				\
+	(head)->hth_oldmask = (head)->hth_mask;				\
+	(head)->hth_migrated = 0;					\
+	(head)->hth_buckets = (buckets);				\
+	(head)->hth_mask = (nbuckets) - 1;				\
+	QMD_NEST_END();							\
+MULTI_LINE_MACRO_END
+
+/*
+ * Sets var to the first element with the given hash for which cond, an
+ * expression over var, holds; NULL if there is none.
+ */
+#define	HTABLE_FIND(head, var, hash, field, cond) MULTI_LINE_MACRO_BEGIN	\
+	DLIST_FOREACH((var), HTABLE_BUCKET((head), (hash)), field.hte_link)\
+		if (HTABLE_HASH((var), field) == (hash) && (cond))	\
+			break;						\
+MULTI_LINE_MACRO_END
+
+#define	HTABLE_INSERT(head, elm, hash, type, field) MULTI_LINE_MACRO_BEGIN\
+	QMD_OP(HTABLE_INSERT);						\
+	QMD_NEST_BEGIN();						\
+	HTABLE_MIGRATE((head), HTABLE_MIGRATE_STEP, type, field);	\
+	HTABLE_HASH((elm), field) = (hash);				\
+	DLIST_INSERT_HEAD(HTABLE_BUCKET((head), HTABLE_HASH((elm), field)),\
+	    (elm), field.hte_link);					\
+	(head)->hth_count++;						\
+	QMD_NEST_END();							\
+MULTI_LINE_MACRO_END
+
+#define	HTABLE_REMOVE(head, elm, type, field) MULTI_LINE_MACRO_BEGIN	\
+	QMD_OP(HTABLE_REMOVE);						\
+	QMD_NEST_BEGIN();						\
+	DLIST_REMOVE((elm), field.hte_link);				\
+	(head)->hth_count--;						\
+	HTABLE_MIGRATE((head), HTABLE_MIGRATE_STEP, type, field);	\
+	QMD_NEST_END();							\
+MULTI_LINE_MACRO_END
+
+/*
+ * Atomic and layout primitives shared by the lock-free families.
+ *
+ * Orders are given by suffix, eg QUEUE_ATOMIC_LOAD(ptr, ACQUIRE). Only the
+ * GCC/clang __atomic builtins are wired up; other compilers may use the
+ * classic families above but not the lock-free ones below.
+ */
+#ifndef QUEUE_CACHE_LINE_SIZE
+#define	QUEUE_CACHE_LINE_SIZE	64
+#endif
+
+#define	QUEUE_CACHE_ALIGNED	__aligned(QUEUE_CACHE_LINE_SIZE)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define	QUEUE_ATOMIC_LOAD(ptr, order)					\
+	__atomic_load_n((ptr), __ATOMIC_##order)
+#define	QUEUE_ATOMIC_STORE(ptr, val, order)				\
+	__atomic_store_n((ptr), (val), __ATOMIC_##order)
+#define	QUEUE_ATOMIC_XCHG(ptr, val, order)				\
+	__atomic_exchange_n((ptr), (val), __ATOMIC_##order)
+#define	QUEUE_ATOMIC_CAS(ptr, expectp, val, success, failure)		\
+	__atomic_compare_exchange_n((ptr), (expectp), (val), 0,		\
+	    __ATOMIC_##success, __ATOMIC_##failure)
+#define	QUEUE_ATOMIC_CAS_WEAK(ptr, expectp, val, success, failure)	\
+	__atomic_compare_exchange_n((ptr), (expectp), (val), 1,		\
+	    __ATOMIC_##success, __ATOMIC_##failure)
+#define	QUEUE_ATOMIC_FETCH_ADD(ptr, val, order)				\
+	__atomic_fetch_add((ptr), (val), __ATOMIC_##order)
+#define	QUEUE_ATOMIC_FENCE(order)	__atomic_thread_fence(__ATOMIC_##order)
+
+/* Spin-wait hint; lets a hyperthread sibling run while we poll. */
+#if defined(__i386__) || defined(__x86_64__)
+#define	QUEUE_CPU_RELAX()	__builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define	QUEUE_CPU_RELAX()	__asm __volatile("yield" ::: "memory")
+#else
+#define	QUEUE_CPU_RELAX()	__compiler_membar()
+#endif
+#endif /* __GNUC__ || __clang__ */
+
+/* container_of() for link structures that are not typed to the element. */
+#define	QUEUE_CONTAINEROF(ptr, type, field)				\
+	((QUEUE_TYPEOF(type) *)(void *)					\
+	    ((char *)(ptr) - __offsetof(QUEUE_TYPEOF(type), field)))
+
+/*
+ * Multi-producer single-consumer queue declarations.
+ *
+ * Links are untyped so the head can embed a stub element; see Vyukov's
+ * intrusive MPSC node-based queue. Producers only touch mqh_head, the
+ * consumer only touches mqh_tail, so the two live on separate cache lines.
+ */
+struct mpscq_entry {
+	struct mpscq_entry *mqe_next;	/* next element */
+};
+
+#define	MPSCQ_HEAD(name, type)						\
+struct name {								\
+	struct mpscq_entry *mqh_head;	/* last pushed, producers */	\
+	struct mpscq_entry *mqh_tail QUEUE_CACHE_ALIGNED; /* consumer */\
+	struct mpscq_entry mqh_stub;	/* placeholder when drained */	\
+}
+
+#define	MPSCQ_HEAD_INITIALIZER(head)					\
+	{ &(head).mqh_stub, &(head).mqh_stub, { NULL } }
+
+#define	MPSCQ_ENTRY(type)						\
+	struct mpscq_entry
+
+/*
+ * Multi-producer single-consumer queue functions.
+ */
+#define	MPSCQ_EMPTY(head)						\
+	(QUEUE_ATOMIC_LOAD(&(head)->mqh_head, ACQUIRE) == &(head)->mqh_stub)
+
+#define	MPSCQ_INIT(head) MULTI_LINE_MACRO_BEGIN				\
+	(head)->mqh_stub.mqe_next = NULL;				\
+	(head)->mqh_tail = &(head)->mqh_stub;				\
+	QUEUE_ATOMIC_STORE(&(head)->mqh_head, &(head)->mqh_stub, RELEASE);\
+MULTI_LINE_MACRO_END
+
+/* Safe from any thread. Links the entry itself, not the element. */
+#define	MPSCQ_PUSH_ENTRY(head, entry) MULTI_LINE_MACRO_BEGIN		\
+	struct mpscq_entry *mpscq_elm = (entry);			\
+	struct mpscq_entry *mpscq_prev;					\
+	QUEUE_ATOMIC_STORE(&mpscq_elm->mqe_next, NULL, RELAXED);	\
+	mpscq_prev = QUEUE_ATOMIC_XCHG(&(head)->mqh_head, mpscq_elm, ACQ_REL);\
+	QUEUE_ATOMIC_STORE(&mpscq_prev->mqe_next, mpscq_elm, RELEASE);	\
+MULTI_LINE_MACRO_END
+
+#define	MPSCQ_PUSH(head, elm, field)					\
+	MPSCQ_PUSH_ENTRY((head), &(elm)->field)
+
+/*
+ * Consumer only. Sets var to the oldest element, or NULL if the queue is
+ * empty. May also return NULL while a producer is between its exchange and
+ * its link store; the element becomes visible once that push completes.
+ */
+#define	MPSCQ_POP(head, var, type, field) MULTI_LINE_MACRO_BEGIN		\
+	struct mpscq_entry *mpscq_tail = (head)->mqh_tail;		\
+	struct mpscq_entry *mpscq_next =				\
+	    QUEUE_ATOMIC_LOAD(&mpscq_tail->mqe_next, ACQUIRE);		\
+	(var) = NULL;							\
+	if (mpscq_tail == &(head)->mqh_stub) {				\
+		if (mpscq_next == NULL)					\
+			break;						\
+		(head)->mqh_tail = mpscq_tail = mpscq_next;		\
+		mpscq_next =						\
+		    QUEUE_ATOMIC_LOAD(&mpscq_tail->mqe_next, ACQUIRE);	\
+	}								\
+	if (mpscq_next == NULL) {					\
+		if (mpscq_tail !=					\
+		    QUEUE_ATOMIC_LOAD(&(head)->mqh_head, ACQUIRE))	\
+			break;						\
+		MPSCQ_PUSH_ENTRY((head), &(head)->mqh_stub);		\
+		mpscq_next =						\
+		    QUEUE_ATOMIC_LOAD(&mpscq_tail->mqe_next, ACQUIRE);	\
+		if (mpscq_next == NULL)					\
+			break;						\
+	}								\
+	(head)->mqh_tail = mpscq_next;					\
+	(var) = QUEUE_CONTAINEROF(mpscq_tail, type, field);		\
+MULTI_LINE_MACRO_END
+
 #endif /* !_SYS_QUEUE_H_ */
@@ -0,0 +1,370 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+#include "../interfaces/Mutex.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define	RCU_YIELD()	SwitchToThread()
+#else
+#include <sched.h>
+#define	RCU_YIELD()	sched_yield()
+#endif /* _WIN32 */
+
+/*
+ * Read-copy-update lists.
+ *
+ * The _RCU variants of the DLIST and TAILQ macros let readers traverse a
+ * list while one writer at a time changes it. Writers fill in an element
+ * before publishing it with a release store of the single link readers
+ * follow to it, and unlink an element by storing past it, leaving its own
+ * forward link intact so a reader standing on it carries on. Readers take
+ * no locks and execute no atomic read-modify-writes: _FOREACH_RCU follows
+ * links with dependency-ordered loads, which are plain loads on all common
+ * hardware. Readers may only traverse forward. Writers must exclude each
+ * other, eg with a Mutex.
+ *
+ * An unlinked element may still be under a reader, so it may only be freed
+ * after a grace period, once every reader has passed through a quiescent
+ * state: a point where it holds no references into any RCU list. Grace
+ * periods are tracked per rcu_domain, quiescent-state based (see Desnoyers
+ * et al., "User-Level Implementations of Read-Copy Update"). Each reader
+ * thread registers an rcu_reader and calls RCU_QUIESCENT() between
+ * traversals, say once per event loop iteration; that is a load and a
+ * store to its own cache line. A thread about to block should go offline
+ * so grace periods do not wait for it.
+ *
+ * RCU_SYNCHRONIZE() waits out a grace period. RCU_DEFER() instead queues
+ * an rcu_callback, embedded in the unlinked element, and RCU_RECLAIM()
+ * runs every queued callback after a single grace period, amortising the
+ * wait over a batch of frees:
+ *
+ *	struct route {
+ *		TAILQ_ENTRY(route) link;
+ *		struct rcu_callback free;
+ *		...
+ *	};
+ *
+ *	// reader thread
+ *	RCU_REGISTER(&domain, &reader);
+ *	for (;;) {
+ *		TAILQ_FOREACH_RCU(route, &routes, link)
+ *			...
+ *		RCU_QUIESCENT(&domain, &reader);
+ *	}
+ *
+ *	// writer, holding the routes lock
+ *	TAILQ_REMOVE_RCU(&routes, route, link);
+ *	RCU_DEFER(&domain, &route->free, freeRoute);
+ *	...
+ *	RCU_RECLAIM(&domain);
+ *
+ * A registered thread must go offline before it synchronizes, reclaims,
+ * unregisters or blocks on anything, the domain lock included; otherwise a
+ * grace period may wait on it forever. RCU_DEFER() never blocks.
+ */
+
+/*
+ * RCU list access.
+ */
+#define	RCU_DEREFERENCE(link)	QUEUE_ATOMIC_LOAD(&(link), CONSUME)
+#define	RCU_ASSIGN(link, val)	QUEUE_ATOMIC_STORE(&(link), (val), RELEASE)
+
+/*
+ * RCU list functions.
+ */
+#define	DLIST_FIRST_RCU(head)		RCU_DEREFERENCE(DLIST_FIRST((head)))
+#define	DLIST_NEXT_RCU(elm, field)	RCU_DEREFERENCE(DLIST_NEXT((elm), field))
+
+#define	DLIST_FOREACH_RCU(var, head, field)				\
+	for ((var) = DLIST_FIRST_RCU((head));				\
+	    (var);							\
+	    (var) = DLIST_NEXT_RCU((var), field))
+
+#define	DLIST_INSERT_HEAD_RCU(head, elm, field) MULTI_LINE_MACRO_BEGIN	\
+	if ((DLIST_NEXT((elm), field) = DLIST_FIRST((head))) != NULL)	\
+		DLIST_FIRST((head))->field.le_prev = &DLIST_NEXT((elm), field);\
+	(elm)->field.le_prev = &DLIST_FIRST((head));			\
+	RCU_ASSIGN(DLIST_FIRST((head)), (elm));				\
+MULTI_LINE_MACRO_END
+
+#define	DLIST_INSERT_AFTER_RCU(listelm, elm, field) MULTI_LINE_MACRO_BEGIN\
+	if ((DLIST_NEXT((elm), field) = DLIST_NEXT((listelm), field)) != NULL)\
+		DLIST_NEXT((listelm), field)->field.le_prev =		\
+		    &DLIST_NEXT((elm), field);				\
+	(elm)->field.le_prev = &DLIST_NEXT((listelm), field);		\
+	RCU_ASSIGN(DLIST_NEXT((listelm), field), (elm));		\
+MULTI_LINE_MACRO_END
+
+#define	DLIST_INSERT_BEFORE_RCU(listelm, elm, field) MULTI_LINE_MACRO_BEGIN\
+	(elm)->field.le_prev = (listelm)->field.le_prev;		\
+	DLIST_NEXT((elm), field) = (listelm);				\
+	RCU_ASSIGN(*(listelm)->field.le_prev, (elm));			\
+	(listelm)->field.le_prev = &DLIST_NEXT((elm), field);		\
+MULTI_LINE_MACRO_END
+
+/* elm keeps its forward link for readers still on it. */
+#define	DLIST_REMOVE_RCU(elm, field) MULTI_LINE_MACRO_BEGIN		\
+	if (DLIST_NEXT((elm), field) != NULL)				\
+		DLIST_NEXT((elm), field)->field.le_prev =		\
+		    (elm)->field.le_prev;				\
+	RCU_ASSIGN(*(elm)->field.le_prev, DLIST_NEXT((elm), field));	\
+MULTI_LINE_MACRO_END
+
+#define	TAILQ_FIRST_RCU(head)		RCU_DEREFERENCE(TAILQ_FIRST((head)))
+#define	TAILQ_NEXT_RCU(elm, field)	RCU_DEREFERENCE(TAILQ_NEXT((elm), field))
+
+#define	TAILQ_FOREACH_RCU(var, head, field)				\
+	for ((var) = TAILQ_FIRST_RCU((head));				\
+	    (var);							\
+	    (var) = TAILQ_NEXT_RCU((var), field))
+
+#define	TAILQ_INSERT_HEAD_RCU(head, elm, field) MULTI_LINE_MACRO_BEGIN	\
+	if ((TAILQ_NEXT((elm), field) = TAILQ_FIRST((head))) != NULL)	\
+		TAILQ_FIRST((head))->field.tqe_prev =			\
+		    &TAILQ_NEXT((elm), field);				\
+	else								\
+		(head)->tqh_last = &TAILQ_NEXT((elm), field);		\
+	(elm)->field.tqe_prev = &TAILQ_FIRST((head));			\
+	RCU_ASSIGN(TAILQ_FIRST((head)), (elm));				\
+MULTI_LINE_MACRO_END
+
+#define	TAILQ_INSERT_TAIL_RCU(head, elm, field) MULTI_LINE_MACRO_BEGIN	\
+	TAILQ_NEXT((elm), field) = NULL;				\
+	(elm)->field.tqe_prev = (head)->tqh_last;			\
+	RCU_ASSIGN(*(head)->tqh_last, (elm));				\
+	(head)->tqh_last = &TAILQ_NEXT((elm), field);			\
+MULTI_LINE_MACRO_END
+
+#define	TAILQ_INSERT_AFTER_RCU(head, listelm, elm, field) MULTI_LINE_MACRO_BEGIN\
+	if ((TAILQ_NEXT((elm), field) = TAILQ_NEXT((listelm), field)) != NULL)\
+		TAILQ_NEXT((elm), field)->field.tqe_prev =		\
+		    &TAILQ_NEXT((elm), field);				\
+	else								\
+		(head)->tqh_last = &TAILQ_NEXT((elm), field);		\
+	(elm)->field.tqe_prev = &TAILQ_NEXT((listelm), field);		\
+	RCU_ASSIGN(TAILQ_NEXT((listelm), field), (elm));		\
+MULTI_LINE_MACRO_END
+
+#define	TAILQ_INSERT_BEFORE_RCU(listelm, elm, field) MULTI_LINE_MACRO_BEGIN\
+	(elm)->field.tqe_prev = (listelm)->field.tqe_prev;		\
+	TAILQ_NEXT((elm), field) = (listelm);				\
+	RCU_ASSIGN(*(listelm)->field.tqe_prev, (elm));			\
+	(listelm)->field.tqe_prev = &TAILQ_NEXT((elm), field);		\
+MULTI_LINE_MACRO_END
+
+/* elm keeps its forward link for readers still on it. */
+#define	TAILQ_REMOVE_RCU(head, elm, field) MULTI_LINE_MACRO_BEGIN	\
+	if (TAILQ_NEXT((elm), field) != NULL)				\
+		TAILQ_NEXT((elm), field)->field.tqe_prev =		\
+		    (elm)->field.tqe_prev;				\
+	else								\
+		(head)->tqh_last = (elm)->field.tqe_prev;		\
+	RCU_ASSIGN(*(elm)->field.tqe_prev, TAILQ_NEXT((elm), field));	\
+MULTI_LINE_MACRO_END
+
+/*
+ * Grace period declarations.
+ *
+ * The domain epoch only moves forward, from 1; a reader's epoch is the
+ * domain epoch at its last quiescent state, or 0 while offline. Each
+ * reader's epoch has its own cache line, as only that reader writes it.
+ */
+struct rcu_reader {
+	uint64_t rr_epoch QUEUE_CACHE_ALIGNED;	/* last quiescent epoch */
+	TAILQ_ENTRY(rcu_reader) rr_link;	/* domain's reader list */
+};
+
+struct rcu_callback {
+	struct rcu_callback *rc_next;		/* next queued callback */
+	void (*rc_func)(struct rcu_callback *);	/* runs after a grace period */
+};
+
+TAILQ_HEAD(rcu_readerlist, rcu_reader);
+
+struct rcu_domain {
+	uint64_t rd_epoch QUEUE_CACHE_ALIGNED;	/* current epoch */
+	Mutex *rd_lock;				/* guards rd_readers */
+	struct rcu_readerlist rd_readers;	/* registered readers */
+	struct rcu_callback *rd_pending;	/* deferred, newest first */
+};
+
+/*
+ * Grace period functions.
+ */
+#define	RCU_INIT(domain, lock) MULTI_LINE_MACRO_BEGIN			\
+	(domain)->rd_epoch = 1;						\
+	(domain)->rd_lock = (lock);					\
+	TAILQ_INIT(&(domain)->rd_readers);				\
+	(domain)->rd_pending = NULL;					\
+MULTI_LINE_MACRO_END
+
+/*
+ * RCU_REGISTER(), RCU_UNREGISTER(), RCU_SYNCHRONIZE() and RCU_RECLAIM()
+ * take the domain lock and return its MutexStatusType. If it cannot be
+ * acquired they change nothing: the reader is not (un)registered, no grace
+ * period runs, and deferred callbacks stay queued for a later reclaim.
+ */
+#define	RCU_REGISTER(domain, reader)	rcu_register((domain), (reader))
+#define	RCU_UNREGISTER(domain, reader)	rcu_unregister((domain), (reader))
+
+/*
+ * Declares that the reader holds no references into RCU lists. The acquire
+ * keeps later traversals from starting before the epoch is read; the
+ * release keeps earlier ones from finishing after it is published.
+ */
+#define	RCU_QUIESCENT(domain, reader)					\
+	QUEUE_ATOMIC_STORE(&(reader)->rr_epoch,				\
+	    QUEUE_ATOMIC_LOAD(&(domain)->rd_epoch, ACQUIRE), RELEASE)
+
+/*
+ * Offline readers are skipped by grace periods and must not traverse.
+ * Coming online pairs with the fence in rcu_synchronize_locked(): either
+ * the grace period sees the reader's epoch and waits for it, or the reader
+ * sees every unlink made before the grace period began.
+ */
+#define	RCU_OFFLINE(reader)						\
+	QUEUE_ATOMIC_STORE(&(reader)->rr_epoch, 0, RELEASE)
+#define	RCU_ONLINE(domain, reader) MULTI_LINE_MACRO_BEGIN		\
+	RCU_QUIESCENT((domain), (reader));				\
+	QUEUE_ATOMIC_FENCE(SEQ_CST);					\
+MULTI_LINE_MACRO_END
+
+#define	RCU_SYNCHRONIZE(domain)	rcu_synchronize((domain))
+#define	RCU_RECLAIM(domain)	rcu_reclaim((domain))
+
+#define	RCU_DEFER(domain, cb, func)	rcu_defer((domain), (cb), (func))
+
+/*
+ * Queues cb without taking the lock, so an online reader may defer while
+ * another thread waits on it in a grace period.
+ */
+static __inline __unused void
+rcu_defer(struct rcu_domain *domain, struct rcu_callback *cb,
+    void (*func)(struct rcu_callback *))
+{
+	cb->rc_func = func;
+	cb->rc_next = QUEUE_ATOMIC_LOAD(&domain->rd_pending, RELAXED);
+	while (!QUEUE_ATOMIC_CAS_WEAK(&domain->rd_pending, &cb->rc_next, cb,
+	    RELEASE, RELAXED))
+		;
+}
+
+/* Readers register online. */
+static __inline __unused MutexStatusType
+rcu_register(struct rcu_domain *domain, struct rcu_reader *reader)
+{
+	MutexStatusType status;
+
+	if ((status = INVOKE(domain->rd_lock, acquire)) != MutexStatusSuccess)
+		return (status);
+	QUEUE_ATOMIC_STORE(&reader->rr_epoch,
+	    QUEUE_ATOMIC_LOAD(&domain->rd_epoch, ACQUIRE), RELEASE);
+	TAILQ_INSERT_TAIL(&domain->rd_readers, reader, rr_link);
+	(void)INVOKE(domain->rd_lock, release);
+	return (MutexStatusSuccess);
+}
+
+static __inline __unused MutexStatusType
+rcu_unregister(struct rcu_domain *domain, struct rcu_reader *reader)
+{
+	MutexStatusType status;
+
+	if ((status = INVOKE(domain->rd_lock, acquire)) != MutexStatusSuccess)
+		return (status);
+	TAILQ_REMOVE(&domain->rd_readers, reader, rr_link);
+	(void)INVOKE(domain->rd_lock, release);
+	return (MutexStatusSuccess);
+}
+
+/* Waits for every online reader to pass a quiescent state. Lock held. */
+static __inline __unused void
+rcu_synchronize_locked(struct rcu_domain *domain)
+{
+	struct rcu_reader *reader;
+	uint64_t epoch, seen;
+
+	/* Unlinks made before this are visible to anyone seeing epoch. */
+	epoch = QUEUE_ATOMIC_LOAD(&domain->rd_epoch, RELAXED) + 1;
+	QUEUE_ATOMIC_STORE(&domain->rd_epoch, epoch, SEQ_CST);
+	/* Orders the store before the scan; see RCU_ONLINE(). */
+	QUEUE_ATOMIC_FENCE(SEQ_CST);
+	TAILQ_FOREACH(reader, &domain->rd_readers, rr_link) {
+		while ((seen = QUEUE_ATOMIC_LOAD(&reader->rr_epoch,
+		    ACQUIRE)) != 0 && seen != epoch)
+			RCU_YIELD();
+	}
+}
+
+static __inline __unused MutexStatusType
+rcu_synchronize(struct rcu_domain *domain)
+{
+	MutexStatusType status;
+
+	if ((status = INVOKE(domain->rd_lock, acquire)) != MutexStatusSuccess)
+		return (status);
+	rcu_synchronize_locked(domain);
+	(void)INVOKE(domain->rd_lock, release);
+	return (MutexStatusSuccess);
+}
+
+/* Runs every callback deferred so far, after one grace period. */
+static __inline __unused MutexStatusType
+rcu_reclaim(struct rcu_domain *domain)
+{
+	struct rcu_callback *cb, *next, *last;
+	MutexStatusType status;
+
+	if ((cb = QUEUE_ATOMIC_XCHG(&domain->rd_pending, NULL, ACQUIRE)) == NULL)
+		return (MutexStatusSuccess);
+	if ((status = INVOKE(domain->rd_lock, acquire)) != MutexStatusSuccess) {
+		/* Requeue the batch ahead of anything deferred since. */
+		for (last = cb; last->rc_next != NULL; last = last->rc_next)
+			;
+		last->rc_next = QUEUE_ATOMIC_LOAD(&domain->rd_pending, RELAXED);
+		while (!QUEUE_ATOMIC_CAS_WEAK(&domain->rd_pending,
+		    &last->rc_next, cb, RELEASE, RELAXED))
+			;
+		return (status);
+	}
+	rcu_synchronize_locked(domain);
+	(void)INVOKE(domain->rd_lock, release);
+	for (; cb != NULL; cb = next) {
+		next = cb->rc_next;
+		cb->rc_func(cb);
+	}
+	return (MutexStatusSuccess);
+}
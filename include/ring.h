@@ -0,0 +1,210 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <string.h>
+#include "queue.h"
+
+/*
+ * Bounded single-producer single-consumer ring buffers.
+ *
+ * A ring is headed by a producer index, a consumer index and a power-of-two
+ * sized slot array supplied by the caller. Exactly one thread may enqueue
+ * while exactly one other thread dequeues; neither side takes a lock or
+ * allocates. Elements are stored by value, so rings suit small payloads such
+ * as indices and pointers.
+ *
+ * The producer and consumer indices sit on separate cache lines, and each
+ * side keeps a private copy of the other side's index. The shared index is
+ * only re-read when the private copy says the ring is full (or empty), so in
+ * steady state each side touches the other's cache line once per wrap rather
+ * than once per element. Bulk operations move up to N elements and publish
+ * the new index with a single release store.
+ *
+ * Indices run freely and are masked on access, so a full ring holds exactly
+ * capacity elements.
+ *
+ * Functions are emitted per ring type by RING_GENERATE() and reached through
+ * wrapper macros that take the ring type name:
+ *
+ *	RING_HEAD(intring, int);
+ *	RING_GENERATE(intring, int)
+ *
+ *	static int slots[ 1024 ];
+ *	struct intring ring;
+ *	RING_INIT(&ring, slots, 1024);
+ *	RING_ENQUEUE(intring, &ring, &value);
+ */
+
+/*
+ * Ring declarations.
+ */
+#define	RING_HEAD(name, type)						\
+struct name {								\
+	size_t rh_head;		/* next slot to fill, producer */	\
+	size_t rh_tailcache;	/* producer's copy of rh_tail */	\
+	size_t rh_tail QUEUE_CACHE_ALIGNED; /* next slot to drain */	\
+	size_t rh_headcache;	/* consumer's copy of rh_head */	\
+	type *rh_slots QUEUE_CACHE_ALIGNED; /* read-only after init */	\
+	size_t rh_mask;		/* capacity - 1 */			\
+}
+
+/*
+ * Ring functions.
+ */
+#define	RING_CAPACITY(ring)	((ring)->rh_mask + 1)
+
+/* Approximate unless called from the producer or consumer thread. */
+#define	RING_COUNT(name, ring)	name##_RING_COUNT((ring))
+
+#define	RING_EMPTY(name, ring)	(RING_COUNT(name, (ring)) == 0)
+
+#define	RING_FULL(name, ring)						\
+	(RING_COUNT(name, (ring)) == RING_CAPACITY((ring)))
+
+/* Capacity must be a power of two; slots must hold capacity elements. */
+#define	RING_INIT(ring, slots, capacity) MULTI_LINE_MACRO_BEGIN		\
+	(ring)->rh_head = (ring)->rh_tailcache = 0;			\
+	(ring)->rh_tail = (ring)->rh_headcache = 0;			\
+	(ring)->rh_slots = (slots);					\
+	(ring)->rh_mask = (capacity) - 1;				\
+MULTI_LINE_MACRO_END
+
+#define	RING_ENQUEUE(name, ring, elmp)	name##_RING_ENQUEUE((ring), (elmp))
+#define	RING_DEQUEUE(name, ring, elmp)	name##_RING_DEQUEUE((ring), (elmp))
+#define	RING_ENQUEUE_BULK(name, ring, elms, n)				\
+	name##_RING_ENQUEUE_BULK((ring), (elms), (n))
+#define	RING_DEQUEUE_BULK(name, ring, elms, n)				\
+	name##_RING_DEQUEUE_BULK((ring), (elms), (n))
+
+/*
+ * Emits the ring functions for struct name holding elements of type:
+ *
+ *  - _RING_ENQUEUE_BULK copies up to n elements in and returns how many fit.
+ *  - _RING_DEQUEUE_BULK copies up to n elements out and returns how many
+ *    were available.
+ *  - _RING_ENQUEUE/_RING_DEQUEUE move one element and return 1, or 0 if the
+ *    ring was full/empty.
+ *  - _RING_COUNT returns the number of queued elements.
+ *
+ * Enqueue is producer-only and dequeue is consumer-only.
+ */
+#define	RING_GENERATE(name, type)					\
+static __inline __unused size_t						\
+name##_RING_ENQUEUE_BULK(struct name *ring, const type *elms, size_t n)	\
+{									\
+	size_t head = ring->rh_head;					\
+	size_t capacity = RING_CAPACITY(ring);				\
+	size_t index, first;						\
+									\
+	if (__predict_false(capacity - (head - ring->rh_tailcache) < n))\
+		ring->rh_tailcache =					\
+		    QUEUE_ATOMIC_LOAD(&ring->rh_tail, ACQUIRE);		\
+	if (capacity - (head - ring->rh_tailcache) < n)			\
+		n = capacity - (head - ring->rh_tailcache);		\
+	if (n == 0)							\
+		return (0);						\
+									\
+	/* Copy in at most two runs: up to the end, then wrapped. */	\
+	index = head & ring->rh_mask;					\
+	first = capacity - index < n ? capacity - index : n;		\
+	memcpy(&ring->rh_slots[index], elms, first * sizeof(type));	\
+	memcpy(&ring->rh_slots[0], elms + first, (n - first) * sizeof(type));\
+	QUEUE_ATOMIC_STORE(&ring->rh_head, head + n, RELEASE);		\
+	return (n);							\
+}									\
+									\
+static __inline __unused size_t						\
+name##_RING_DEQUEUE_BULK(struct name *ring, type *elms, size_t n)	\
+{									\
+	size_t tail = ring->rh_tail;					\
+	size_t capacity = RING_CAPACITY(ring);				\
+	size_t index, first;						\
+									\
+	if (__predict_false(ring->rh_headcache - tail < n))		\
+		ring->rh_headcache =					\
+		    QUEUE_ATOMIC_LOAD(&ring->rh_head, ACQUIRE);		\
+	if (ring->rh_headcache - tail < n)				\
+		n = ring->rh_headcache - tail;				\
+	if (n == 0)							\
+		return (0);						\
+									\
+	index = tail & ring->rh_mask;					\
+	first = capacity - index < n ? capacity - index : n;		\
+	memcpy(elms, &ring->rh_slots[index], first * sizeof(type));	\
+	memcpy(elms + first, &ring->rh_slots[0], (n - first) * sizeof(type));\
+	QUEUE_ATOMIC_STORE(&ring->rh_tail, tail + n, RELEASE);		\
+	return (n);							\
+}									\
+									\
+static __inline __unused int						\
+name##_RING_ENQUEUE(struct name *ring, const type *elm)			\
+{									\
+	size_t head = ring->rh_head;					\
+									\
+	if (__predict_false(head - ring->rh_tailcache ==		\
+	    RING_CAPACITY(ring))) {					\
+		ring->rh_tailcache =					\
+		    QUEUE_ATOMIC_LOAD(&ring->rh_tail, ACQUIRE);		\
+		if (head - ring->rh_tailcache == RING_CAPACITY(ring))	\
+			return (0);					\
+	}								\
+	ring->rh_slots[head & ring->rh_mask] = *elm;			\
+	QUEUE_ATOMIC_STORE(&ring->rh_head, head + 1, RELEASE);		\
+	return (1);							\
+}									\
+									\
+static __inline __unused int						\
+name##_RING_DEQUEUE(struct name *ring, type *elm)			\
+{									\
+	size_t tail = ring->rh_tail;					\
+									\
+	if (__predict_false(ring->rh_headcache == tail)) {		\
+		ring->rh_headcache =					\
+		    QUEUE_ATOMIC_LOAD(&ring->rh_head, ACQUIRE);		\
+		if (ring->rh_headcache == tail)				\
+			return (0);					\
+	}								\
+	*elm = ring->rh_slots[tail & ring->rh_mask];			\
+	QUEUE_ATOMIC_STORE(&ring->rh_tail, tail + 1, RELEASE);		\
+	return (1);							\
+}									\
+									\
+static __inline __unused size_t						\
+name##_RING_COUNT(struct name *ring)					\
+{									\
+	/* Tail first: the head can only move away from it. */		\
+	size_t tail = QUEUE_ATOMIC_LOAD(&ring->rh_tail, ACQUIRE);	\
+	size_t count = QUEUE_ATOMIC_LOAD(&ring->rh_head, ACQUIRE) - tail;\
+									\
+	return (count > RING_CAPACITY(ring) ? RING_CAPACITY(ring) : count);\
+}
@@ -0,0 +1,397 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+
+#ifdef _WIN32
+#error "shmring.h requires POSIX shared memory"
+#endif /* _WIN32 */
+
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+/*
+ * Inter-process single-producer single-consumer rings.
+ *
+ * A shared-memory ring lives entirely inside one mapping of a memfd_create()
+ * or shm_open() file: a header followed by a power-of-two array of
+ * fixed-size slots. One process produces and one consumes, as for ring.h,
+ * with the same private copies of the other side's index to keep the
+ * indices' cache lines from bouncing.
+ *
+ * Each process works through its own struct shmring handle. It records
+ * where the file is mapped, so each process may map it at a different
+ * address, and a copy of the ring's geometry, checked when the handle is
+ * bound: the peer can write the shared header, and must not be able to
+ * move slots outside the mapping by doing so.
+ *
+ * Payloads are written and read in place, without copies: the producer
+ * reserves the next free slot, fills it and commits it; the consumer peeks
+ * at the oldest slot, reads it and releases it. No system call is made
+ * while the ring is neither empty nor full. A side finding it so may wait,
+ * spinning briefly and then sleeping on the other side's index with a
+ * shared futex (yielding, where there are no futexes). A side only wakes
+ * the other when it has announced it is asleep, which costs one fence per
+ * commit or release. The announcement is kept on the waker's cache line,
+ * so checking it costs no transfer.
+ *
+ *	// creator
+ *	struct shmring ring;
+ *	int fd = memfd_create("requests", MFD_CLOEXEC);
+ *	shmring_create(&ring, fd, 256, 1024);
+ *	// ...pass fd to the peer, eg over a unix socket...
+ *
+ *	// peer
+ *	struct shmring ring;
+ *	shmring_attach(&ring, fd);
+ *
+ *	// producer
+ *	struct request *req = shmring_reserve_wait(&ring);
+ *	fill(req);
+ *	shmring_commit(&ring);
+ *
+ *	// consumer
+ *	struct request *req = shmring_peek_wait(&ring);
+ *	handle(req);
+ *	shmring_release(&ring);
+ *
+ * Only the first 32 bits of the indices are shared, as futexes are 32-bit
+ * words, so capacity is at most 2^31 slots.
+ */
+#ifndef SHMRING_SPIN
+#define	SHMRING_SPIN	128	/* polls before sleeping */
+#endif
+
+#define	SHMRING_MAGIC	0x53524e47u	/* "SRNG" */
+
+/* Header at the start of the shared memory. */
+struct shmring_shared {
+	uint32_t ss_magic;		/* SHMRING_MAGIC once initialised */
+	uint32_t ss_slotsize;		/* bytes per slot */
+	uint32_t ss_mask;		/* capacity - 1 */
+	uint32_t ss_offset;		/* slot array, from the header */
+	uint64_t ss_size;		/* bytes mapped */
+	uint32_t ss_head QUEUE_CACHE_ALIGNED; /* next slot to fill */
+	uint32_t ss_tailcache;		/* producer's copy of ss_tail */
+	uint32_t ss_consumerwait;	/* consumer asleep on ss_head */
+	uint32_t ss_tail QUEUE_CACHE_ALIGNED; /* next slot to drain */
+	uint32_t ss_headcache;		/* consumer's copy of ss_head */
+	uint32_t ss_producerwait;	/* producer asleep on ss_tail */
+};
+
+/* A process's handle on a ring. */
+struct shmring {
+	struct shmring_shared *sr_shared;
+	char *sr_slots;
+	size_t sr_size;			/* bytes mapped */
+	uint32_t sr_slotsize;		/* validated copies of the header */
+	uint32_t sr_mask;
+};
+
+#define	SHMRING_CAPACITY(ring)	((ring)->sr_mask + 1)
+#define	SHMRING_SLOT(ring, index)					\
+	((void *)((ring)->sr_slots +					\
+	    (size_t)((index) & (ring)->sr_mask) * (ring)->sr_slotsize))
+
+/* Sleeps while *word is value, or yields where there are no futexes. */
+static __inline __unused void
+shmring_sleep(uint32_t *word, uint32_t value)
+{
+#ifdef __linux__
+	(void)syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+#else
+	(void)word;
+	(void)value;
+	sched_yield();
+#endif /* __linux__ */
+}
+
+static __inline __unused void
+shmring_wake(uint32_t *word)
+{
+#ifdef __linux__
+	(void)syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+	(void)word;
+#endif /* __linux__ */
+}
+
+/* Bytes of shared memory for a ring of capacity slots of slotsize bytes. */
+static __inline __unused uint64_t
+shmring_footprint(uint32_t slotsize, uint32_t capacity)
+{
+	return (sizeof(struct shmring_shared) + (uint64_t)slotsize * capacity);
+}
+
+/* Lays out an empty ring over memory; capacity must be a power of two. */
+static __inline __unused void
+shmring_init(struct shmring_shared *shared, uint32_t slotsize,
+    uint32_t capacity)
+{
+	shared->ss_slotsize = slotsize;
+	shared->ss_mask = capacity - 1;
+	shared->ss_offset = sizeof(struct shmring_shared);
+	shared->ss_size = shmring_footprint(slotsize, capacity);
+	shared->ss_head = shared->ss_tailcache = shared->ss_consumerwait = 0;
+	shared->ss_tail = shared->ss_headcache = shared->ss_producerwait = 0;
+	QUEUE_ATOMIC_STORE(&shared->ss_magic, SHMRING_MAGIC, RELEASE);
+}
+
+/*
+ * Points ring at the initialised ring in the size bytes of memory, after
+ * checking that the header describes slots within them. Returns 0, or -1
+ * with errno set.
+ */
+static __inline __unused int
+shmring_bind(struct shmring *ring, void *memory, size_t size)
+{
+	struct shmring_shared *shared = (struct shmring_shared *)memory;
+	uint32_t slotsize, mask;
+
+	if (size < sizeof(struct shmring_shared) ||
+	    QUEUE_ATOMIC_LOAD(&shared->ss_magic, ACQUIRE) != SHMRING_MAGIC) {
+		errno = EINVAL;
+		return (-1);
+	}
+	slotsize = shared->ss_slotsize;
+	mask = shared->ss_mask;
+	if (shared->ss_offset != sizeof(struct shmring_shared) ||
+	    (mask & (mask + 1)) != 0 || mask >= (uint32_t)1 << 31 ||
+	    shared->ss_size != size ||
+	    shmring_footprint(slotsize, mask + 1) != size) {
+		errno = EINVAL;
+		return (-1);
+	}
+	ring->sr_shared = shared;
+	ring->sr_slots = (char *)memory + sizeof(struct shmring_shared);
+	ring->sr_size = size;
+	ring->sr_slotsize = slotsize;
+	ring->sr_mask = mask;
+	return (0);
+}
+
+/*
+ * Sizes the empty shared memory file fd for a ring, maps it, initialises
+ * the ring and binds ring to it. Returns 0, or -1 with errno set.
+ */
+static __inline __unused int
+shmring_create(struct shmring *ring, int fd, uint32_t slotsize,
+    uint32_t capacity)
+{
+	uint64_t size = shmring_footprint(slotsize, capacity);
+	void *memory;
+
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+	    capacity > (uint32_t)1 << 31 || size > SIZE_MAX) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (ftruncate(fd, (off_t)size) != 0)
+		return (-1);
+	memory = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+	if (memory == MAP_FAILED)
+		return (-1);
+	shmring_init((struct shmring_shared *)memory, slotsize, capacity);
+	return (shmring_bind(ring, memory, (size_t)size));
+}
+
+/*
+ * Maps the ring in the shared memory file fd, created by shmring_create()
+ * in another process, and binds ring to it. Returns 0, or -1 with errno
+ * set.
+ */
+static __inline __unused int
+shmring_attach(struct shmring *ring, int fd)
+{
+	struct stat st;
+	void *memory;
+
+	if (fstat(fd, &st) != 0)
+		return (-1);
+	if ((size_t)st.st_size < sizeof(struct shmring_shared)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	memory = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED)
+		return (-1);
+	if (shmring_bind(ring, memory, (size_t)st.st_size) != 0) {
+		(void)munmap(memory, (size_t)st.st_size);
+		errno = EINVAL;
+		return (-1);
+	}
+	return (0);
+}
+
+static __inline __unused int
+shmring_detach(struct shmring *ring)
+{
+	return (munmap(ring->sr_shared, ring->sr_size));
+}
+
+/*
+ * Producer side.
+ */
+
+/* The next free slot, or NULL if the ring is full. */
+static __inline __unused void *
+shmring_reserve(struct shmring *ring)
+{
+	struct shmring_shared *shared = ring->sr_shared;
+	uint32_t head = shared->ss_head;
+
+	if (__predict_false(head - shared->ss_tailcache ==
+	    SHMRING_CAPACITY(ring))) {
+		shared->ss_tailcache = QUEUE_ATOMIC_LOAD(&shared->ss_tail,
+		    ACQUIRE);
+		if (head - shared->ss_tailcache == SHMRING_CAPACITY(ring))
+			return (NULL);
+	}
+	return (SHMRING_SLOT(ring, head));
+}
+
+/* Publishes the reserved slot. */
+static __inline __unused void
+shmring_commit(struct shmring *ring)
+{
+	struct shmring_shared *shared = ring->sr_shared;
+
+	QUEUE_ATOMIC_STORE(&shared->ss_head, shared->ss_head + 1, RELEASE);
+	/* Orders the store before reading the flag; pairs with the wait. */
+	QUEUE_ATOMIC_FENCE(SEQ_CST);
+	if (__predict_false(QUEUE_ATOMIC_LOAD(&shared->ss_consumerwait,
+	    RELAXED)))
+		shmring_wake(&shared->ss_head);
+}
+
+/* The next free slot, waiting for the consumer while the ring is full. */
+static __inline __unused void *
+shmring_reserve_wait(struct shmring *ring)
+{
+	struct shmring_shared *shared = ring->sr_shared;
+	uint32_t tail;
+	void *slot;
+	int spin;
+
+	for (spin = 0; (slot = shmring_reserve(ring)) == NULL; spin++) {
+		if (spin < SHMRING_SPIN) {
+			QUEUE_CPU_RELAX();
+			continue;
+		}
+		QUEUE_ATOMIC_STORE(&shared->ss_producerwait, 1, RELAXED);
+		QUEUE_ATOMIC_FENCE(SEQ_CST);
+		tail = QUEUE_ATOMIC_LOAD(&shared->ss_tail, ACQUIRE);
+		if (shared->ss_head - tail == SHMRING_CAPACITY(ring))
+			shmring_sleep(&shared->ss_tail, tail);
+		QUEUE_ATOMIC_STORE(&shared->ss_producerwait, 0, RELAXED);
+	}
+	return (slot);
+}
+
+/*
+ * Consumer side.
+ */
+
+/* The oldest committed slot, or NULL if the ring is empty. */
+static __inline __unused void *
+shmring_peek(struct shmring *ring)
+{
+	struct shmring_shared *shared = ring->sr_shared;
+	uint32_t tail = shared->ss_tail;
+
+	if (__predict_false(shared->ss_headcache == tail)) {
+		shared->ss_headcache = QUEUE_ATOMIC_LOAD(&shared->ss_head,
+		    ACQUIRE);
+		if (shared->ss_headcache == tail)
+			return (NULL);
+	}
+	return (SHMRING_SLOT(ring, tail));
+}
+
+/* Hands the peeked slot back to the producer. */
+static __inline __unused void
+shmring_release(struct shmring *ring)
+{
+	struct shmring_shared *shared = ring->sr_shared;
+
+	QUEUE_ATOMIC_STORE(&shared->ss_tail, shared->ss_tail + 1, RELEASE);
+	QUEUE_ATOMIC_FENCE(SEQ_CST);
+	if (__predict_false(QUEUE_ATOMIC_LOAD(&shared->ss_producerwait,
+	    RELAXED)))
+		shmring_wake(&shared->ss_tail);
+}
+
+/* The oldest committed slot, waiting for the producer while empty. */
+static __inline __unused void *
+shmring_peek_wait(struct shmring *ring)
+{
+	struct shmring_shared *shared = ring->sr_shared;
+	uint32_t head;
+	void *slot;
+	int spin;
+
+	for (spin = 0; (slot = shmring_peek(ring)) == NULL; spin++) {
+		if (spin < SHMRING_SPIN) {
+			QUEUE_CPU_RELAX();
+			continue;
+		}
+		QUEUE_ATOMIC_STORE(&shared->ss_consumerwait, 1, RELAXED);
+		QUEUE_ATOMIC_FENCE(SEQ_CST);
+		head = QUEUE_ATOMIC_LOAD(&shared->ss_head, ACQUIRE);
+		if (head == shared->ss_tail)
+			shmring_sleep(&shared->ss_head, head);
+		QUEUE_ATOMIC_STORE(&shared->ss_consumerwait, 0, RELAXED);
+	}
+	return (slot);
+}
+
+/* Approximate unless called from the producer or consumer. */
+static __inline __unused uint32_t
+shmring_count(struct shmring *ring)
+{
+	struct shmring_shared *shared = ring->sr_shared;
+	uint32_t tail = QUEUE_ATOMIC_LOAD(&shared->ss_tail, ACQUIRE);
+
+	return (QUEUE_ATOMIC_LOAD(&shared->ss_head, ACQUIRE) - tail);
+}
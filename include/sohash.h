@@ -0,0 +1,523 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "queue.h"
+#include "lflist.h"
+#include "../interfaces/Allocator.h"
+
+/*
+ * Lock-free split-ordered hash maps (see Shalev and Shavit, "Split-Ordered
+ * Lists: Lock-Free Extensible Hash Tables").
+ *
+ * Every element sits in one lock-free sorted list, ordered by its hash with
+ * the bits reversed, so the elements of any bucket are contiguous and each
+ * bucket of a table with 2n buckets is a sublist of a bucket of a table with
+ * n. A bucket is a pointer to a dummy node marking the start of its run. The
+ * table doubles by bumping a counter; new buckets are initialised lazily,
+ * by inserting a dummy node after that of their parent bucket, the bucket
+ * whose index is theirs without the top bit. No element ever moves and no
+ * operation ever waits for a resize.
+ *
+ * Elements are intrusive and are linked and removed as in lflist.h, with
+ * the same tagged next pointers. Dummy nodes and the bucket array come from
+ * an Allocator instance; the array grows by whole segments, each as large
+ * as all before it, so bucket pointers never move either. If an allocation
+ * fails, operations start from the nearest initialised ancestor bucket,
+ * which is slower but still correct. Lookups only read, never initialise
+ * buckets, and never write.
+ *
+ * As with lflist.h, removed elements may still be under concurrent
+ * lookups. Run map operations as RCU readers and free removed elements
+ * through RCU_DEFER() (see rcu.h).
+ *
+ * Functions are emitted per map type by SOHASH_GENERATE(), which takes the
+ * key type, the element member holding the key, a hash function or macro,
+ * hash(key) -> size_t, and an equality function or macro, eq(key, key) ->
+ * int, as for LRU_GENERATE():
+ *
+ *	struct session {
+ *		SOHASH_ENTRY(session) link;
+ *		uint64_t id;
+ *		struct rcu_callback free;
+ *	};
+ *	SOHASH_HEAD(sessionmap, session);
+ *	SOHASH_GENERATE(sessionmap, session, link, uint64_t, id, hashId, EQ_ID)
+ *
+ *	SOHASH_INIT(sessionmap, &map, allocator);
+ *	SOHASH_INSERT(sessionmap, &map, session);
+ *	session = SOHASH_FIND(sessionmap, &map, id);
+ *	if ((session = SOHASH_REMOVE(sessionmap, &map, id)) != NULL)
+ *		RCU_DEFER(&domain, &session->free, freeSession);
+ */
+#ifndef SOHASH_SEGMENT_BITS
+#define	SOHASH_SEGMENT_BITS	6	/* log2 buckets in segment 0 */
+#endif
+#ifndef SOHASH_SEGMENTS
+#define	SOHASH_SEGMENTS		24
+#endif
+#ifndef SOHASH_LOAD_FACTOR
+#define	SOHASH_LOAD_FACTOR	2	/* elements per bucket */
+#endif
+
+#define	SOHASH_MAX_BUCKETS						\
+	((size_t)1 << (SOHASH_SEGMENT_BITS + SOHASH_SEGMENTS - 1))
+
+/*
+ * Split-ordered hash map declarations.
+ *
+ * Split-order keys reverse the hash with the top bit set for elements, so
+ * element keys are odd, and reverse the bucket index for dummy nodes, so
+ * theirs are even and sort before the elements of their bucket.
+ */
+struct sohash_entry {
+	struct sohash_entry *she_next;	/* next node, maybe marked */
+	uint64_t she_key;		/* split-order key */
+};
+
+#define	SOHASH_HEAD(name, type)						\
+struct name {								\
+	struct sohash_entry sh_list;	/* bucket 0's dummy */		\
+	size_t sh_size;			/* buckets in use */		\
+	Allocator *sh_allocator;	/* dummies and segments */	\
+	struct sohash_entry **sh_segments[SOHASH_SEGMENTS];		\
+	size_t sh_count QUEUE_CACHE_ALIGNED; /* elements */		\
+}
+
+#define	SOHASH_ENTRY(type)						\
+	struct sohash_entry
+
+/*
+ * Split-ordered hash map functions.
+ */
+#define	SOHASH_COUNT(map)	QUEUE_ATOMIC_LOAD(&(map)->sh_count, RELAXED)
+
+#define	SOHASH_INIT(name, map, allocator)				\
+	name##_SOHASH_INIT((map), (allocator))
+#define	SOHASH_DESTROY(name, map)	name##_SOHASH_DESTROY((map))
+#define	SOHASH_INSERT(name, map, elm)	name##_SOHASH_INSERT((map), (elm))
+#define	SOHASH_REMOVE(name, map, key)	name##_SOHASH_REMOVE((map), (key))
+#define	SOHASH_FIND(name, map, key)	name##_SOHASH_FIND((map), (key))
+#define	SOHASH_FIRST(name, map)		name##_SOHASH_FIRST((map))
+#define	SOHASH_NEXT(name, elm)		name##_SOHASH_NEXT((elm))
+
+/* Visits the elements present throughout, in split order. */
+#define	SOHASH_FOREACH(var, name, map)					\
+	for ((var) = SOHASH_FIRST(name, (map));				\
+	    (var) != NULL;						\
+	    (var) = SOHASH_NEXT(name, (var)))
+
+static __inline __unused uint64_t
+sohash_reverse(uint64_t bits)
+{
+	bits = ((bits >> 1) & 0x5555555555555555ull) |
+	    ((bits & 0x5555555555555555ull) << 1);
+	bits = ((bits >> 2) & 0x3333333333333333ull) |
+	    ((bits & 0x3333333333333333ull) << 2);
+	bits = ((bits >> 4) & 0x0f0f0f0f0f0f0f0full) |
+	    ((bits & 0x0f0f0f0f0f0f0f0full) << 4);
+#if defined(__GNUC__) || defined(__clang__)
+	return (__builtin_bswap64(bits));
+#else
+	bits = ((bits >> 8) & 0x00ff00ff00ff00ffull) |
+	    ((bits & 0x00ff00ff00ff00ffull) << 8);
+	bits = ((bits >> 16) & 0x0000ffff0000ffffull) |
+	    ((bits & 0x0000ffff0000ffffull) << 16);
+	return ((bits >> 32) | (bits << 32));
+#endif
+}
+
+#define	SOHASH_ELEMENT_KEY(hash)					\
+	sohash_reverse((uint64_t)(hash) | ((uint64_t)1 << 63))
+#define	SOHASH_DUMMY_KEY(bucket)	sohash_reverse((uint64_t)(bucket))
+
+/* Index of the highest set bit; bits must be non-zero. */
+static __inline __unused unsigned
+sohash_last_bit(size_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return ((unsigned)(sizeof(unsigned long long) * 8 - 1 -
+	    __builtin_clzll((unsigned long long)bits)));
+#else
+	unsigned index = 0;
+
+	while (bits >>= 1)
+		index++;
+	return (index);
+#endif
+}
+
+/* Segment 0 holds the first buckets, segment s > 0 those at 2^(s-1+bits). */
+static __inline __unused unsigned
+sohash_segment(size_t bucket)
+{
+	if (bucket < ((size_t)1 << SOHASH_SEGMENT_BITS))
+		return (0);
+	return (sohash_last_bit(bucket) - SOHASH_SEGMENT_BITS + 1);
+}
+
+static __inline __unused size_t
+sohash_segment_base(unsigned segment)
+{
+	return (segment == 0 ? 0 :
+	    (size_t)1 << (segment - 1 + SOHASH_SEGMENT_BITS));
+}
+
+static __inline __unused size_t
+sohash_segment_size(unsigned segment)
+{
+	return ((size_t)1 << (segment == 0 ? SOHASH_SEGMENT_BITS :
+	    segment - 1 + SOHASH_SEGMENT_BITS));
+}
+
+/* The bucket whose run bucket's run was split from. */
+static __inline __unused size_t
+sohash_parent(size_t bucket)
+{
+	return (bucket & ~((size_t)1 << sohash_last_bit(bucket)));
+}
+
+/*
+ * Returns the first unmarked node after start whose key is not before key,
+ * or, if past is set, is after it, and sets *prevp to the link that pointed
+ * at it. Unlinks the marked nodes it passes. start is a dummy node, which
+ * is never removed.
+ */
+static __inline __unused struct sohash_entry *
+sohash_search(struct sohash_entry *start, uint64_t key, int past,
+    struct sohash_entry ***prevp)
+{
+	struct sohash_entry **prev, *curr, *next;
+
+retry:
+	prev = &start->she_next;
+	curr = QUEUE_ATOMIC_LOAD(prev, ACQUIRE);
+	while (curr != NULL) {
+		next = QUEUE_ATOMIC_LOAD(&curr->she_next, ACQUIRE);
+		if (LFLIST_IS_MARKED(next)) {
+			next = LFLIST_UNMARK(sohash_entry, next);
+			if (!QUEUE_ATOMIC_CAS(prev, &curr, next, ACQ_REL,
+			    ACQUIRE))
+				goto retry;
+			curr = next;
+			continue;
+		}
+		if (curr->she_key > key || (curr->she_key == key && !past))
+			break;
+		prev = &curr->she_next;
+		curr = next;
+	}
+	*prevp = prev;
+	return (curr);
+}
+
+/* The next unmarked element node after node, skipping dummies. */
+static __inline __unused struct sohash_entry *
+sohash_next(struct sohash_entry *node)
+{
+	struct sohash_entry *next;
+
+	for (;;) {
+		node = LFLIST_UNMARK(sohash_entry,
+		    QUEUE_ATOMIC_LOAD(&node->she_next, ACQUIRE));
+		if (node == NULL)
+			return (NULL);
+		next = QUEUE_ATOMIC_LOAD(&node->she_next, ACQUIRE);
+		if ((node->she_key & 1) != 0 && !LFLIST_IS_MARKED(next))
+			return (node);
+	}
+}
+
+/*
+ * Emits the split-ordered hash map functions for struct name over struct
+ * type elements linked through field and keyed by keyfield:
+ *
+ *  - _SOHASH_INIT allocates the first segment of buckets.
+ *  - _SOHASH_DESTROY frees buckets and dummy nodes, once no other thread
+ *    can reach the map. Remaining elements are left alone.
+ *  - _SOHASH_START returns the dummy node of bucket, or of its nearest
+ *    initialised ancestor; _SOHASH_BUCKET initialises bucket first.
+ *  - _SOHASH_INSERT adds elm and returns NULL, or returns the element with
+ *    an equal key if there is one.
+ *  - _SOHASH_REMOVE removes and returns the element with key, or NULL.
+ *    Exactly one of several racing removers gets it.
+ *  - _SOHASH_FIND returns the element with key, or NULL.
+ *  - _SOHASH_FIRST and _SOHASH_NEXT step over elements in split order.
+ */
+#define	SOHASH_GENERATE(name, type, field, keytype, keyfield, hash, eq)\
+static __inline __unused AllocatorStatusType				\
+name##_SOHASH_INIT(struct name *map, Allocator *allocator)		\
+{									\
+	void *memory;							\
+	AllocatorStatusType status;					\
+									\
+	status = INVOKE(allocator, allocate, &memory,			\
+	    sohash_segment_size(0) * sizeof(struct sohash_entry *),	\
+	    CALL_TRACE);						\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	memset(memory, 0, sohash_segment_size(0) *			\
+	    sizeof(struct sohash_entry *));				\
+	memset(map->sh_segments, 0, sizeof(map->sh_segments));		\
+	map->sh_segments[0] = (struct sohash_entry **)memory;		\
+	map->sh_segments[0][0] = &map->sh_list;				\
+	map->sh_list.she_next = NULL;					\
+	map->sh_list.she_key = SOHASH_DUMMY_KEY(0);			\
+	map->sh_size = 2;						\
+	map->sh_allocator = allocator;					\
+	QUEUE_ATOMIC_STORE(&map->sh_count, 0, RELEASE);			\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused void						\
+name##_SOHASH_DESTROY(struct name *map)					\
+{									\
+	struct sohash_entry *node, *next;				\
+	void *memory;							\
+	unsigned segment;						\
+									\
+	for (node = map->sh_list.she_next; node != NULL; node = next) {\
+		next = LFLIST_UNMARK(sohash_entry, node->she_next);	\
+		if ((node->she_key & 1) == 0) {				\
+			memory = node;					\
+			(void)INVOKE(map->sh_allocator, free, &memory,	\
+			    CALL_TRACE);				\
+		}							\
+	}								\
+	for (segment = 0; segment < SOHASH_SEGMENTS; segment++) {	\
+		if ((memory = map->sh_segments[segment]) == NULL)	\
+			continue;					\
+		(void)INVOKE(map->sh_allocator, free, &memory, CALL_TRACE);\
+		map->sh_segments[segment] = NULL;			\
+	}								\
+	map->sh_list.she_next = NULL;					\
+}									\
+									\
+static __inline __unused struct sohash_entry *				\
+name##_SOHASH_START(struct name *map, size_t bucket)			\
+{									\
+	struct sohash_entry **buckets, *dummy;				\
+	unsigned segment;						\
+									\
+	for (;;) {							\
+		segment = sohash_segment(bucket);			\
+		buckets = QUEUE_ATOMIC_LOAD(&map->sh_segments[segment],	\
+		    ACQUIRE);						\
+		if (buckets != NULL && (dummy = QUEUE_ATOMIC_LOAD(	\
+		    &buckets[bucket - sohash_segment_base(segment)],	\
+		    ACQUIRE)) != NULL)					\
+			return (dummy);					\
+		bucket = sohash_parent(bucket);				\
+	}								\
+}									\
+									\
+static __noinline __unused struct sohash_entry *			\
+name##_SOHASH_BUCKET(struct name *map, size_t bucket)			\
+{									\
+	struct sohash_entry **buckets, **prev, *start, *dummy, *curr;	\
+	void *memory;							\
+	unsigned segment;						\
+	size_t size;							\
+	uint64_t key;							\
+									\
+	segment = sohash_segment(bucket);				\
+	buckets = QUEUE_ATOMIC_LOAD(&map->sh_segments[segment], ACQUIRE);\
+	if (buckets == NULL) {						\
+		size = sohash_segment_size(segment) *			\
+		    sizeof(struct sohash_entry *);			\
+		if (INVOKE(map->sh_allocator, allocate, &memory, size,	\
+		    CALL_TRACE) != AllocatorStatusSuccess)		\
+			return (name##_SOHASH_START(map, bucket));	\
+		memset(memory, 0, size);				\
+		if (!QUEUE_ATOMIC_CAS(&map->sh_segments[segment],	\
+		    &buckets, (struct sohash_entry **)memory, ACQ_REL,	\
+		    ACQUIRE))						\
+			(void)INVOKE(map->sh_allocator, free, &memory,	\
+			    CALL_TRACE);				\
+		else							\
+			buckets = (struct sohash_entry **)memory;	\
+	}								\
+	dummy = QUEUE_ATOMIC_LOAD(					\
+	    &buckets[bucket - sohash_segment_base(segment)], ACQUIRE);	\
+	if (dummy != NULL)						\
+		return (dummy);						\
+	start = name##_SOHASH_BUCKET(map, sohash_parent(bucket));	\
+	if (INVOKE(map->sh_allocator, allocate, &memory,		\
+	    sizeof(struct sohash_entry), CALL_TRACE) != AllocatorStatusSuccess)\
+		return (start);						\
+	dummy = (struct sohash_entry *)memory;				\
+	dummy->she_key = key = SOHASH_DUMMY_KEY(bucket);		\
+	for (;;) {							\
+		curr = sohash_search(start, key, 0, &prev);		\
+		if (curr != NULL && curr->she_key == key) {		\
+			/* Another thread initialised it first. */	\
+			(void)INVOKE(map->sh_allocator, free, &memory,	\
+			    CALL_TRACE);				\
+			dummy = curr;					\
+			break;						\
+		}							\
+		QUEUE_ATOMIC_STORE(&dummy->she_next, curr, RELAXED);	\
+		if (QUEUE_ATOMIC_CAS(prev, &curr, dummy, RELEASE, RELAXED))\
+			break;						\
+	}								\
+	QUEUE_ATOMIC_STORE(&buckets[bucket - sohash_segment_base(segment)],\
+	    dummy, RELEASE);						\
+	return (dummy);							\
+}									\
+									\
+/* The bucket for hash, initialised, in a table of the current size. */	\
+static __inline __unused struct sohash_entry *				\
+name##_SOHASH_LOCATE(struct name *map, size_t hashed)			\
+{									\
+	struct sohash_entry **buckets, *dummy;				\
+	size_t bucket;							\
+	unsigned segment;						\
+									\
+	bucket = hashed & (QUEUE_ATOMIC_LOAD(&map->sh_size, RELAXED) - 1);\
+	segment = sohash_segment(bucket);				\
+	buckets = QUEUE_ATOMIC_LOAD(&map->sh_segments[segment], ACQUIRE);\
+	if (buckets != NULL && (dummy = QUEUE_ATOMIC_LOAD(		\
+	    &buckets[bucket - sohash_segment_base(segment)], ACQUIRE)) != NULL)\
+		return (dummy);						\
+	return (name##_SOHASH_BUCKET(map, bucket));			\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_SOHASH_INSERT(struct name *map, struct type *elm)		\
+{									\
+	struct sohash_entry **prev, *start, *curr, *node, *next;	\
+	size_t hashed, size, count;					\
+	uint64_t key;							\
+									\
+	hashed = hash(elm->keyfield);					\
+	key = SOHASH_ELEMENT_KEY(hashed);				\
+	start = name##_SOHASH_LOCATE(map, hashed);			\
+	elm->field.she_key = key;					\
+	for (;;) {							\
+		curr = sohash_search(start, key, 0, &prev);		\
+		/* Equal keys share a run; every insert links at its head. */\
+		for (node = curr; node != NULL && node->she_key == key;	\
+		    node = LFLIST_UNMARK(sohash_entry, next)) {		\
+			next = QUEUE_ATOMIC_LOAD(&node->she_next, ACQUIRE);\
+			if (!LFLIST_IS_MARKED(next) && eq(QUEUE_CONTAINEROF(\
+			    node, type, field)->keyfield, elm->keyfield))\
+				return (QUEUE_CONTAINEROF(node, type, field));\
+		}							\
+		QUEUE_ATOMIC_STORE(&elm->field.she_next, curr, RELAXED);\
+		if (QUEUE_ATOMIC_CAS(prev, &curr, &elm->field, RELEASE,	\
+		    RELAXED))						\
+			break;						\
+	}								\
+	count = QUEUE_ATOMIC_FETCH_ADD(&map->sh_count, 1, RELAXED) + 1;	\
+	size = QUEUE_ATOMIC_LOAD(&map->sh_size, RELAXED);		\
+	if (count > size * SOHASH_LOAD_FACTOR && size < SOHASH_MAX_BUCKETS)\
+		(void)QUEUE_ATOMIC_CAS(&map->sh_size, &size, size * 2,	\
+		    RELAXED, RELAXED);					\
+	return (NULL);							\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_SOHASH_REMOVE(struct name *map, keytype key)			\
+{									\
+	struct sohash_entry **prev, *start, *curr, *next, *expect;	\
+	size_t hashed;							\
+	uint64_t sokey;							\
+									\
+	hashed = hash(key);						\
+	sokey = SOHASH_ELEMENT_KEY(hashed);				\
+	start = name##_SOHASH_LOCATE(map, hashed);			\
+	for (;;) {							\
+		curr = sohash_search(start, sokey, 0, &prev);		\
+		for (; curr != NULL && curr->she_key == sokey;		\
+		    curr = LFLIST_UNMARK(sohash_entry, next)) {		\
+			next = QUEUE_ATOMIC_LOAD(&curr->she_next, ACQUIRE);\
+			if (!LFLIST_IS_MARKED(next) && eq(QUEUE_CONTAINEROF(\
+			    curr, type, field)->keyfield, key))		\
+				break;					\
+			prev = &curr->she_next;				\
+		}							\
+		if (curr == NULL || curr->she_key != sokey)		\
+			return (NULL);					\
+		if (!QUEUE_ATOMIC_CAS(&curr->she_next, &next,		\
+		    LFLIST_MARK(sohash_entry, next), ACQ_REL, RELAXED))	\
+			continue;					\
+		/* Marked, so ours; a search unlinks it if we cannot. */\
+		expect = curr;						\
+		if (!QUEUE_ATOMIC_CAS(prev, &expect, next, ACQ_REL, RELAXED))\
+			(void)sohash_search(start, sokey, 1, &prev);	\
+		QUEUE_ATOMIC_FETCH_ADD(&map->sh_count, (size_t)-1, RELAXED);\
+		return (QUEUE_CONTAINEROF(curr, type, field));		\
+	}								\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_SOHASH_FIND(struct name *map, keytype key)			\
+{									\
+	struct sohash_entry *node, *next;				\
+	size_t hashed;							\
+	uint64_t sokey;							\
+									\
+	hashed = hash(key);						\
+	sokey = SOHASH_ELEMENT_KEY(hashed);				\
+	node = name##_SOHASH_START(map,					\
+	    hashed & (QUEUE_ATOMIC_LOAD(&map->sh_size, RELAXED) - 1));	\
+	while (node != NULL && node->she_key < sokey)			\
+		node = LFLIST_UNMARK(sohash_entry,			\
+		    QUEUE_ATOMIC_LOAD(&node->she_next, ACQUIRE));	\
+	for (; node != NULL && node->she_key == sokey;			\
+	    node = LFLIST_UNMARK(sohash_entry, next)) {			\
+		next = QUEUE_ATOMIC_LOAD(&node->she_next, ACQUIRE);	\
+		if (!LFLIST_IS_MARKED(next) && eq(QUEUE_CONTAINEROF(	\
+		    node, type, field)->keyfield, key))			\
+			return (QUEUE_CONTAINEROF(node, type, field));	\
+	}								\
+	return (NULL);							\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_SOHASH_FIRST(struct name *map)					\
+{									\
+	struct sohash_entry *node = sohash_next(&map->sh_list);		\
+									\
+	return (node == NULL ? NULL : QUEUE_CONTAINEROF(node, type, field));\
+}									\
+									\
+static __inline __unused struct type *					\
+name##_SOHASH_NEXT(struct type *elm)					\
+{									\
+	struct sohash_entry *node = sohash_next(&elm->field);		\
+									\
+	return (node == NULL ? NULL : QUEUE_CONTAINEROF(node, type, field));\
+}
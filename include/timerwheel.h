@@ -0,0 +1,288 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stdint.h>
+#include "queue.h"
+
+/*
+ * Hierarchical timing wheels.
+ *
+ * A timing wheel is headed by the current tick and TIMERWHEEL_LEVELS rings
+ * of 64 TAILQ buckets; timers embed a TIMERWHEEL_ENTRY holding their TAILQ
+ * link, expiry tick and bucket. Level 0 buckets cover single ticks, and each
+ * level above covers 64 times the span of the one below (see Varghese and
+ * Lauck, "Hashed and Hierarchical Timing Wheels"). Timers further out than
+ * the top level can reach wait on an overflow list.
+ *
+ * Arming appends to one bucket and cancelling unlinks from it, both O(1)
+ * whatever the number of timers; a timer cancelled before it fires, the
+ * common case for timeouts, never costs more than that. Advancing moves due
+ * level 0 buckets onto the caller's expired list whole, and when a level 0
+ * rotation completes, cascades the next bucket of the level above down into
+ * finer buckets. Per-level occupancy bitmaps let advance skip empty ticks.
+ *
+ * Functions are emitted per wheel type by TIMERWHEEL_GENERATE():
+ *
+ *	struct conn {
+ *		TIMERWHEEL_ENTRY(conn) timeout;
+ *		...
+ *	};
+ *	TIMERWHEEL_HEAD(connwheel, conn);
+ *	TIMERWHEEL_GENERATE(connwheel, conn, timeout)
+ *
+ *	TIMERWHEEL_INIT(connwheel, &wheel, nowTicks);
+ *	TIMERWHEEL_ARM(connwheel, &wheel, conn, nowTicks + 30);
+ *	TIMERWHEEL_CANCEL(connwheel, &wheel, conn);
+ *
+ *	TIMERWHEEL_LIST(connwheel) expired = TAILQ_HEAD_INITIALIZER(expired);
+ *	TIMERWHEEL_ADVANCE(connwheel, &wheel, nowTicks, &expired);
+ *	while ((conn = TAILQ_FIRST(&expired)) != NULL) {
+ *		TIMERWHEEL_CANCEL(connwheel, &wheel, conn);	// unlinks
+ *		...
+ *	}
+ */
+#ifndef TIMERWHEEL_LEVELS
+#define	TIMERWHEEL_LEVELS	4
+#endif
+
+#define	TIMERWHEEL_SLOT_BITS	6	/* one uint64_t occupancy word */
+#define	TIMERWHEEL_SLOTS	(1 << TIMERWHEEL_SLOT_BITS)
+#define	TIMERWHEEL_SLOT_MASK	(TIMERWHEEL_SLOTS - 1)
+
+/*
+ * Timing wheel declarations.
+ */
+#define	TIMERWHEEL_LIST(name)	struct name##_twlist
+
+#define	TIMERWHEEL_HEAD(name, type)					\
+TAILQ_HEAD(name##_twlist, type);					\
+struct name {								\
+	uint64_t twh_now;		/* last processed tick */	\
+	size_t twh_count;		/* timers not yet expired */	\
+	uint64_t twh_occupied[TIMERWHEEL_LEVELS]; /* non-empty slots */	\
+	TIMERWHEEL_LIST(name) twh_overflow; /* beyond the top level */	\
+	TIMERWHEEL_LIST(name) twh_slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];\
+}
+
+#define	TIMERWHEEL_ENTRY(type)						\
+struct {								\
+	TAILQ_ENTRY(type) twe_link;	/* bucket linkage */		\
+	uint64_t twe_expiry;		/* tick to fire at */		\
+	void *twe_bucket;		/* list holding us, or NULL */	\
+}
+
+/*
+ * Timing wheel functions.
+ */
+#define	TIMERWHEEL_NOW(wheel)		((wheel)->twh_now)
+#define	TIMERWHEEL_COUNT(wheel)		((wheel)->twh_count)
+#define	TIMERWHEEL_EXPIRY(elm, field)	((elm)->field.twe_expiry)
+#define	TIMERWHEEL_ARMED(elm, field)	((elm)->field.twe_bucket != NULL)
+
+/* Marks a timer as unarmed; required before its first use. */
+#define	TIMERWHEEL_ENTRY_INIT(elm, field) MULTI_LINE_MACRO_BEGIN	\
+	(elm)->field.twe_bucket = NULL;					\
+MULTI_LINE_MACRO_END
+
+#define	TIMERWHEEL_INIT(name, wheel, now)				\
+	name##_TIMERWHEEL_INIT((wheel), (now))
+#define	TIMERWHEEL_ARM(name, wheel, elm, expiry)			\
+	name##_TIMERWHEEL_ARM((wheel), (elm), (expiry))
+#define	TIMERWHEEL_CANCEL(name, wheel, elm)				\
+	name##_TIMERWHEEL_CANCEL((wheel), (elm))
+#define	TIMERWHEEL_ADVANCE(name, wheel, to, expired)			\
+	name##_TIMERWHEEL_ADVANCE((wheel), (to), (expired))
+
+/*
+ * Emits the wheel functions for struct name over struct type timers linked
+ * through field:
+ *
+ *  - _TIMERWHEEL_INIT empties the wheel and sets the current tick.
+ *  - _TIMERWHEEL_ARM (re)arms a timer to fire at expiry; expiries at or
+ *    before the current tick fire on the next advance.
+ *  - _TIMERWHEEL_CANCEL disarms a timer and returns 1, or 0 if it was not
+ *    armed. Timers on an expired list are unlinked from that list.
+ *  - _TIMERWHEEL_ADVANCE processes every tick up to and including to,
+ *    appending due timers to expired in expiry order, and returns how many
+ *    expired. They stay armed, linked on expired, until cancelled or
+ *    re-armed, but no longer count toward TIMERWHEEL_COUNT().
+ */
+#define	TIMERWHEEL_GENERATE(name, type, field)				\
+static __inline __unused void						\
+name##_TIMERWHEEL_INIT(struct name *wheel, uint64_t now)		\
+{									\
+	unsigned level, slot;						\
+									\
+	wheel->twh_now = now;						\
+	wheel->twh_count = 0;						\
+	TAILQ_INIT(&wheel->twh_overflow);				\
+	for (level = 0; level < TIMERWHEEL_LEVELS; level++) {		\
+		wheel->twh_occupied[level] = 0;				\
+		for (slot = 0; slot < TIMERWHEEL_SLOTS; slot++)		\
+			TAILQ_INIT(&wheel->twh_slots[level][slot]);	\
+	}								\
+}									\
+									\
+/* Files a timer relative to twh_now, treating it as due no earlier	\
+ * than floor. */							\
+static __inline __unused void						\
+name##_TIMERWHEEL_PLACE(struct name *wheel, struct type *elm,		\
+    uint64_t floor)							\
+{									\
+	uint64_t expiry = elm->field.twe_expiry;			\
+	TIMERWHEEL_LIST(name) *bucket = &wheel->twh_overflow;		\
+	unsigned level, shift, slot;					\
+									\
+	if (expiry < floor)						\
+		expiry = floor;						\
+	/* Lowest level whose span holds both now and the expiry. */	\
+	for (level = 0; level < TIMERWHEEL_LEVELS; level++) {		\
+		shift = TIMERWHEEL_SLOT_BITS * (level + 1);		\
+		if (shift >= 64 || (expiry >> shift) == (wheel->twh_now >> shift)) {\
+			slot = (unsigned)(expiry >> (shift -		\
+			    TIMERWHEEL_SLOT_BITS)) & TIMERWHEEL_SLOT_MASK;\
+			bucket = &wheel->twh_slots[level][slot];	\
+			wheel->twh_occupied[level] |= (uint64_t)1 << slot;\
+			break;						\
+		}							\
+	}								\
+	TAILQ_INSERT_TAIL(bucket, elm, field.twe_link);			\
+	elm->field.twe_bucket = bucket;					\
+}									\
+									\
+static __inline __unused int						\
+name##_TIMERWHEEL_CANCEL(struct name *wheel, struct type *elm)		\
+{									\
+	TIMERWHEEL_LIST(name) *bucket =					\
+	    (TIMERWHEEL_LIST(name) *)elm->field.twe_bucket;		\
+	uintptr_t offset;						\
+	size_t index;							\
+									\
+	if (bucket == NULL)						\
+		return (0);						\
+	TAILQ_REMOVE(bucket, elm, field.twe_link);			\
+	elm->field.twe_bucket = NULL;					\
+	/* Compared as integers: bucket may be the caller's expired list. */\
+	offset = (uintptr_t)bucket - (uintptr_t)&wheel->twh_slots[0][0];\
+	if (offset < sizeof(wheel->twh_slots)) {			\
+		wheel->twh_count--;					\
+		index = (size_t)offset / sizeof(*bucket);		\
+		if (TAILQ_EMPTY(bucket))				\
+			wheel->twh_occupied[index / TIMERWHEEL_SLOTS] &=\
+			    ~((uint64_t)1 << (index % TIMERWHEEL_SLOTS));\
+	} else if (bucket == &wheel->twh_overflow)			\
+		wheel->twh_count--;					\
+	return (1);							\
+}									\
+									\
+static __inline __unused void						\
+name##_TIMERWHEEL_ARM(struct name *wheel, struct type *elm,		\
+    uint64_t expiry)							\
+{									\
+	name##_TIMERWHEEL_CANCEL(wheel, elm);				\
+	elm->field.twe_expiry = expiry;					\
+	name##_TIMERWHEEL_PLACE(wheel, elm, wheel->twh_now + 1);	\
+	wheel->twh_count++;						\
+}									\
+									\
+/* Re-files every timer on a bucket against the current tick. */	\
+static __inline __unused void						\
+name##_TIMERWHEEL_CASCADE(struct name *wheel, TIMERWHEEL_LIST(name) *bucket)\
+{									\
+	TIMERWHEEL_LIST(name) pending = TAILQ_HEAD_INITIALIZER(pending);\
+	struct type *elm;						\
+									\
+	TAILQ_CONCAT(&pending, bucket, field.twe_link);			\
+	while ((elm = TAILQ_FIRST(&pending)) != NULL) {			\
+		TAILQ_REMOVE(&pending, elm, field.twe_link);		\
+		name##_TIMERWHEEL_PLACE(wheel, elm, wheel->twh_now);	\
+	}								\
+}									\
+									\
+static __inline __unused size_t						\
+name##_TIMERWHEEL_ADVANCE(struct name *wheel, uint64_t to,		\
+    TIMERWHEEL_LIST(name) *expired)					\
+{									\
+	TIMERWHEEL_LIST(name) *bucket;					\
+	struct type *elm;						\
+	uint64_t tick, skip;						\
+	unsigned level, slot;						\
+	size_t count = 0;						\
+									\
+	while (wheel->twh_now < to) {					\
+		if (wheel->twh_count == 0) {				\
+			wheel->twh_now = to;				\
+			break;						\
+		}							\
+		/* Nothing left at level 0: jump to the next rotation. */\
+		if (wheel->twh_occupied[0] == 0) {			\
+			skip = wheel->twh_now | TIMERWHEEL_SLOT_MASK;	\
+			wheel->twh_now = skip < to ? skip : to;		\
+			if (wheel->twh_now == to)			\
+				break;					\
+		}							\
+		tick = ++wheel->twh_now;				\
+									\
+		/* Cascade from the highest level whose turn it is. */	\
+		for (level = 0; level < TIMERWHEEL_LEVELS; level++)	\
+			if ((tick >> (TIMERWHEEL_SLOT_BITS * level)) &	\
+			    TIMERWHEEL_SLOT_MASK)			\
+				break;					\
+		if (level == TIMERWHEEL_LEVELS) {			\
+			name##_TIMERWHEEL_CASCADE(wheel, &wheel->twh_overflow);\
+			level--;					\
+		}							\
+		for (; level > 0; level--) {				\
+			slot = (unsigned)(tick >> (TIMERWHEEL_SLOT_BITS * level)) &\
+			    TIMERWHEEL_SLOT_MASK;			\
+			if (!(wheel->twh_occupied[level] & ((uint64_t)1 << slot)))\
+				continue;				\
+			wheel->twh_occupied[level] &= ~((uint64_t)1 << slot);\
+			name##_TIMERWHEEL_CASCADE(wheel,		\
+			    &wheel->twh_slots[level][slot]);		\
+		}							\
+									\
+		slot = (unsigned)tick & TIMERWHEEL_SLOT_MASK;		\
+		bucket = &wheel->twh_slots[0][slot];			\
+		if (TAILQ_EMPTY(bucket))				\
+			continue;					\
+		TAILQ_FOREACH(elm, bucket, field.twe_link) {		\
+			elm->field.twe_bucket = expired;		\
+			count++;					\
+			wheel->twh_count--;				\
+		}							\
+		TAILQ_CONCAT(expired, bucket, field.twe_link);		\
+		wheel->twh_occupied[0] &= ~((uint64_t)1 << slot);	\
+	}								\
+	return (count);							\
+}
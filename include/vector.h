@@ -0,0 +1,278 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "cdefs.h"
+#include "../interfaces/Allocator.h"
+
+/*
+ * Growable contiguous arrays.
+ *
+ * A vector keeps its elements in one block from an Allocator instance, in
+ * order and without gaps, so iterating is a linear scan of memory: the
+ * shape to use for data read far more often than it is inserted into.
+ * Appending is amortized constant time. The block grows by doubling,
+ * first trying the allocator's optional in-place resize, and falling back
+ * to allocating a new block, copying and freeing the old one. Elements
+ * are moved with memcpy(), so pointers into a vector are invalidated by
+ * anything that may grow, shrink or shift it.
+ *
+ * Functions are emitted per vector type by VECTOR_GENERATE():
+ *
+ *	VECTOR_HEAD(samples, double);
+ *	VECTOR_GENERATE(samples, double)
+ *
+ *	struct samples vec;
+ *	double *sample;
+ *	VECTOR_INIT(samples, &vec, allocator);
+ *	VECTOR_PUSH(samples, &vec, 4.2);
+ *	VECTOR_FOREACH(sample, &vec)
+ *		total += *sample;
+ */
+
+/* Capacity allocated by the first growth. */
+#ifndef VECTOR_MIN_CAPACITY
+#define	VECTOR_MIN_CAPACITY	8
+#endif
+
+/*
+ * Vector declarations.
+ */
+#define	VECTOR_HEAD(name, type)						\
+struct name {								\
+	type *vh_data;			/* vh_capacity elements */	\
+	size_t vh_count;		/* elements in use */		\
+	size_t vh_capacity;		/* elements allocated */	\
+	Allocator *vh_allocator;	/* source of vh_data */		\
+}
+
+/*
+ * Vector functions.
+ */
+#define	VECTOR_DATA(vec)	((vec)->vh_data)
+#define	VECTOR_COUNT(vec)	((vec)->vh_count)
+#define	VECTOR_CAPACITY(vec)	((vec)->vh_capacity)
+#define	VECTOR_EMPTY(vec)	((vec)->vh_count == 0)
+#define	VECTOR_AT(vec, index)	((vec)->vh_data[(index)])
+#define	VECTOR_LAST(vec)	VECTOR_AT((vec), (vec)->vh_count - 1)
+#define	VECTOR_CLEAR(vec)	((vec)->vh_count = 0)
+
+#define	VECTOR_INIT(name, vec, allocator)				\
+	name##_VECTOR_INIT((vec), (allocator))
+#define	VECTOR_DESTROY(name, vec)	name##_VECTOR_DESTROY((vec))
+#define	VECTOR_RESERVE(name, vec, count)				\
+	name##_VECTOR_RESERVE((vec), (count))
+#define	VECTOR_PUSH(name, vec, value)	name##_VECTOR_PUSH((vec), (value))
+#define	VECTOR_POP(name, vec, valuep)	name##_VECTOR_POP((vec), (valuep))
+#define	VECTOR_INSERT(name, vec, index, value)				\
+	name##_VECTOR_INSERT((vec), (index), (value))
+#define	VECTOR_ERASE(name, vec, index, count)				\
+	name##_VECTOR_ERASE((vec), (index), (count))
+#define	VECTOR_SHRINK(name, vec)	name##_VECTOR_SHRINK((vec))
+
+/* var points at each element in turn; the vector must not be resized. */
+#define	VECTOR_FOREACH(var, vec)					\
+	for ((var) = (vec)->vh_data;					\
+	    (var) != NULL && (var) < (vec)->vh_data + (vec)->vh_count;	\
+	    (var)++)
+
+#define	VECTOR_FOREACH_REVERSE(var, vec)				\
+	for ((var) = (vec)->vh_count == 0 ? NULL :			\
+	    (vec)->vh_data + (vec)->vh_count - 1;			\
+	    (var) != NULL;						\
+	    (var) = (var) == (vec)->vh_data ? NULL : (var) - 1)
+
+/*
+ * Emits the vector functions for struct name, holding elements of type:
+ *
+ *  - _VECTOR_INIT sets up an empty vector; nothing is allocated until the
+ *    first growth. _VECTOR_DESTROY returns the block to the allocator.
+ *  - _VECTOR_RESERVE makes room for count elements without regrowth.
+ *  - _VECTOR_PUSH appends value; _VECTOR_INSERT puts it at index, shifting
+ *    the elements from index on up by one.
+ *  - _VECTOR_POP removes the last element, stores it in *valuep unless
+ *    valuep is NULL, and returns 1, or 0 if the vector was empty.
+ *  - _VECTOR_ERASE removes count elements from index on, shifting those
+ *    after them down.
+ *  - _VECTOR_SHRINK releases capacity beyond the elements in use.
+ *
+ * Functions that may allocate return the allocator's status, and leave the
+ * vector unchanged on failure.
+ */
+#define	VECTOR_GENERATE(name, type)					\
+static __inline __unused void						\
+name##_VECTOR_INIT(struct name *vec, Allocator *allocator)		\
+{									\
+	vec->vh_data = NULL;						\
+	vec->vh_count = 0;						\
+	vec->vh_capacity = 0;						\
+	vec->vh_allocator = allocator;					\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_VECTOR_DESTROY(struct name *vec)					\
+{									\
+	void *memory = vec->vh_data;					\
+	AllocatorStatusType status = AllocatorStatusSuccess;		\
+									\
+	if (memory != NULL)						\
+		status = INVOKE(vec->vh_allocator, free, &memory,	\
+		    CALL_TRACE);					\
+	name##_VECTOR_INIT(vec, vec->vh_allocator);			\
+	return (status);						\
+}									\
+									\
+/* Moves the elements to a block of capacity elements, which may be 0. */\
+static __noinline __unused AllocatorStatusType				\
+name##_VECTOR_REALLOCATE(struct name *vec, size_t capacity)		\
+{									\
+	Allocator *allocator = vec->vh_allocator;			\
+	void *memory;							\
+	AllocatorStatusType status;					\
+									\
+	if (capacity > SIZE_MAX / sizeof(type))				\
+		return (AllocatorStatusFailure);			\
+	if (vec->vh_data != NULL && capacity != 0 &&			\
+	    allocator->resize != NULL &&				\
+	    allocator->resize(allocator, vec->vh_data,			\
+	    capacity * sizeof(type), CALL_TRACE) ==			\
+	    AllocatorStatusSuccess) {					\
+		vec->vh_capacity = capacity;				\
+		return (AllocatorStatusSuccess);			\
+	}								\
+	memory = NULL;							\
+	if (capacity != 0) {						\
+		status = INVOKE(allocator, allocate, &memory,		\
+		    capacity * sizeof(type), CALL_TRACE);		\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+		if (vec->vh_count != 0)					\
+			memcpy(memory, vec->vh_data,			\
+			    vec->vh_count * sizeof(type));		\
+	}								\
+	/*								\
+	 * The elements already live in the new block, so a failure to	\
+	 * release the old one leaks it rather than failing the caller.	\
+	 */								\
+	if (vec->vh_data != NULL) {					\
+		void *old = vec->vh_data;				\
+									\
+		(void)INVOKE(allocator, free, &old, CALL_TRACE);	\
+	}								\
+	vec->vh_data = (type *)memory;					\
+	vec->vh_capacity = capacity;					\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+/* Grows to hold at least count elements, doubling at a minimum. */	\
+static __noinline __unused AllocatorStatusType				\
+name##_VECTOR_GROW(struct name *vec, size_t count)			\
+{									\
+	size_t capacity = vec->vh_capacity;				\
+									\
+	if (capacity < VECTOR_MIN_CAPACITY)				\
+		capacity = VECTOR_MIN_CAPACITY;				\
+	else if (capacity <= SIZE_MAX / 2)				\
+		capacity *= 2;						\
+	if (capacity < count)						\
+		capacity = count;					\
+	return (name##_VECTOR_REALLOCATE(vec, capacity));		\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_VECTOR_RESERVE(struct name *vec, size_t count)			\
+{									\
+	if (count <= vec->vh_capacity)					\
+		return (AllocatorStatusSuccess);			\
+	return (name##_VECTOR_REALLOCATE(vec, count));			\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_VECTOR_PUSH(struct name *vec, type value)			\
+{									\
+	AllocatorStatusType status;					\
+									\
+	if (__predict_false(vec->vh_count == vec->vh_capacity)) {	\
+		status = name##_VECTOR_GROW(vec, vec->vh_count + 1);	\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+	}								\
+	vec->vh_data[vec->vh_count++] = value;				\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused int						\
+name##_VECTOR_POP(struct name *vec, type *valuep)			\
+{									\
+	if (vec->vh_count == 0)						\
+		return (0);						\
+	vec->vh_count--;						\
+	if (valuep != NULL)						\
+		*valuep = vec->vh_data[vec->vh_count];			\
+	return (1);							\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_VECTOR_INSERT(struct name *vec, size_t index, type value)	\
+{									\
+	AllocatorStatusType status;					\
+									\
+	if (__predict_false(vec->vh_count == vec->vh_capacity)) {	\
+		status = name##_VECTOR_GROW(vec, vec->vh_count + 1);	\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+	}								\
+	memmove(&vec->vh_data[index + 1], &vec->vh_data[index],		\
+	    (vec->vh_count - index) * sizeof(type));			\
+	vec->vh_data[index] = value;					\
+	vec->vh_count++;						\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused void						\
+name##_VECTOR_ERASE(struct name *vec, size_t index, size_t count)	\
+{									\
+	memmove(&vec->vh_data[index], &vec->vh_data[index + count],	\
+	    (vec->vh_count - index - count) * sizeof(type));		\
+	vec->vh_count -= count;						\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_VECTOR_SHRINK(struct name *vec)					\
+{									\
+	if (vec->vh_count == vec->vh_capacity)				\
+		return (AllocatorStatusSuccess);			\
+	return (name##_VECTOR_REALLOCATE(vec, vec->vh_count));		\
+}
@@ -0,0 +1,272 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include "queue.h"
+#include "../interfaces/Allocator.h"
+
+/*
+ * Chase-Lev work-stealing deques.
+ *
+ * A work-stealing deque is owned by one thread, which pushes and pops at the
+ * bottom like a stack, while any number of thief threads steal from the top.
+ * The owner only synchronises with thieves when the deque is down to its last
+ * element, so the common push/pop path costs a fence rather than a lock.
+ *
+ * Elements live in a circular array that the owner doubles when it fills.
+ * Thieves may still be reading a replaced array, so replaced arrays are
+ * chained off the new one and only returned to the Allocator instance when
+ * the deque is destroyed; the chain never holds more than the final array.
+ *
+ * Orderings follow Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (PPoPP 2013). Elements are read by
+ * thieves while the owner may overwrite them, so type must be a pointer or
+ * integer type.
+ *
+ * Functions are emitted per deque type by WSDEQUE_GENERATE():
+ *
+ *	WSDEQUE_HEAD(taskdeque, struct task *);
+ *	WSDEQUE_GENERATE(taskdeque, struct task *)
+ *
+ *	struct taskdeque deque;
+ *	WSDEQUE_INIT(taskdeque, &deque, allocator, 256);
+ *	WSDEQUE_PUSH(taskdeque, &deque, task);		// owner
+ *	WSDEQUE_POP(taskdeque, &deque, &task);		// owner
+ *	WSDEQUE_STEAL(taskdeque, &deque, &task);	// any thread
+ */
+
+/** Work-stealing result type. */
+typedef enum {
+	WorkStealStatusSuccess,	/**< An element was taken. */
+	WorkStealStatusEmpty,	/**< Nothing to take. */
+	WorkStealStatusAbort,	/**< Lost a race for the last element; retry. */
+} WorkStealStatusType;
+
+/*
+ * Work-stealing deque declarations.
+ */
+#define	WSDEQUE_ARRAY(name)	struct name##_wsdeque_array
+
+#define	WSDEQUE_HEAD(name, type)					\
+WSDEQUE_ARRAY(name) {							\
+	WSDEQUE_ARRAY(name) *wa_retired; /* replaced, smaller array */	\
+	size_t wa_mask;			/* capacity - 1 */		\
+	type wa_slots[];						\
+};									\
+struct name {								\
+	ptrdiff_t wh_top QUEUE_CACHE_ALIGNED;	/* steal end */		\
+	ptrdiff_t wh_bottom QUEUE_CACHE_ALIGNED; /* owner end */	\
+	WSDEQUE_ARRAY(name) *wh_array;	/* current array */		\
+	Allocator *wh_allocator;	/* source of arrays */		\
+}
+
+/*
+ * Work-stealing deque functions.
+ */
+#define	WSDEQUE_INIT(name, deque, allocator, capacity)			\
+	name##_WSDEQUE_INIT((deque), (allocator), (capacity))
+#define	WSDEQUE_DESTROY(name, deque)	name##_WSDEQUE_DESTROY((deque))
+#define	WSDEQUE_PUSH(name, deque, elm)	name##_WSDEQUE_PUSH((deque), (elm))
+#define	WSDEQUE_POP(name, deque, elmp)	name##_WSDEQUE_POP((deque), (elmp))
+#define	WSDEQUE_STEAL(name, deque, elmp)				\
+	name##_WSDEQUE_STEAL((deque), (elmp))
+
+/* Approximate unless called from the owner with no thieves running. */
+#define	WSDEQUE_COUNT(deque)						\
+	((size_t)(QUEUE_ATOMIC_LOAD(&(deque)->wh_bottom, RELAXED) -	\
+	    QUEUE_ATOMIC_LOAD(&(deque)->wh_top, RELAXED)))
+
+#define	WSDEQUE_EMPTY(deque)	((ptrdiff_t)WSDEQUE_COUNT((deque)) <= 0)
+
+/*
+ * Emits the deque functions for struct name holding elements of type:
+ *
+ *  - _WSDEQUE_INIT allocates the initial array; capacity must be a power of
+ *    two. _WSDEQUE_DESTROY frees every array. Both return the allocator's
+ *    status.
+ *  - _WSDEQUE_PUSH appends at the bottom, growing the array if needed, and
+ *    returns the allocator's status. Owner only.
+ *  - _WSDEQUE_POP removes from the bottom. Owner only.
+ *  - _WSDEQUE_STEAL removes from the top. Any thread.
+ *
+ * POP and STEAL write *elmp only when they return WorkStealStatusSuccess.
+ */
+#define	WSDEQUE_GENERATE(name, type)					\
+static __inline __unused AllocatorStatusType				\
+name##_WSDEQUE_ALLOCATE(struct name *deque, WSDEQUE_ARRAY(name) **arrayp,\
+    size_t capacity)							\
+{									\
+	void *memory;							\
+	AllocatorStatusType status;					\
+									\
+	status = INVOKE(deque->wh_allocator, allocate, &memory,		\
+	    sizeof(WSDEQUE_ARRAY(name)) + capacity * sizeof(type),	\
+	    CALL_TRACE);						\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	*arrayp = (WSDEQUE_ARRAY(name) *)memory;			\
+	(*arrayp)->wa_retired = NULL;					\
+	(*arrayp)->wa_mask = capacity - 1;				\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_WSDEQUE_INIT(struct name *deque, Allocator *allocator,		\
+    size_t capacity)							\
+{									\
+	WSDEQUE_ARRAY(name) *array;					\
+	AllocatorStatusType status;					\
+									\
+	deque->wh_allocator = allocator;				\
+	status = name##_WSDEQUE_ALLOCATE(deque, &array, capacity);	\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	QUEUE_ATOMIC_STORE(&deque->wh_top, 0, RELAXED);			\
+	QUEUE_ATOMIC_STORE(&deque->wh_bottom, 0, RELAXED);		\
+	QUEUE_ATOMIC_STORE(&deque->wh_array, array, RELEASE);		\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_WSDEQUE_DESTROY(struct name *deque)				\
+{									\
+	WSDEQUE_ARRAY(name) *array = deque->wh_array;			\
+	AllocatorStatusType status = AllocatorStatusSuccess;		\
+	void *memory;							\
+									\
+	while (array != NULL) {						\
+		memory = array;						\
+		array = array->wa_retired;				\
+		if (INVOKE(deque->wh_allocator, free, &memory,		\
+		    CALL_TRACE) != AllocatorStatusSuccess)		\
+			status = AllocatorStatusFailure;		\
+	}								\
+	deque->wh_array = NULL;						\
+	return (status);						\
+}									\
+									\
+/* Doubles the array, keeping elements at the same logical index. */	\
+static __noinline __unused AllocatorStatusType				\
+name##_WSDEQUE_GROW(struct name *deque, ptrdiff_t top, ptrdiff_t bottom)\
+{									\
+	WSDEQUE_ARRAY(name) *old = deque->wh_array;			\
+	WSDEQUE_ARRAY(name) *array;					\
+	AllocatorStatusType status;					\
+	ptrdiff_t index;						\
+									\
+	status = name##_WSDEQUE_ALLOCATE(deque, &array,			\
+	    (old->wa_mask + 1) * 2);					\
+	if (status != AllocatorStatusSuccess)				\
+		return (status);					\
+	for (index = top; index < bottom; index++)			\
+		array->wa_slots[(size_t)index & array->wa_mask] =	\
+		    QUEUE_ATOMIC_LOAD(					\
+		    &old->wa_slots[(size_t)index & old->wa_mask], RELAXED);\
+	array->wa_retired = old;					\
+	QUEUE_ATOMIC_STORE(&deque->wh_array, array, RELEASE);		\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused AllocatorStatusType				\
+name##_WSDEQUE_PUSH(struct name *deque, type elm)			\
+{									\
+	ptrdiff_t bottom = QUEUE_ATOMIC_LOAD(&deque->wh_bottom, RELAXED);\
+	ptrdiff_t top = QUEUE_ATOMIC_LOAD(&deque->wh_top, ACQUIRE);	\
+	WSDEQUE_ARRAY(name) *array = deque->wh_array;			\
+	AllocatorStatusType status;					\
+									\
+	if (__predict_false((size_t)(bottom - top) > array->wa_mask)) {	\
+		status = name##_WSDEQUE_GROW(deque, top, bottom);	\
+		if (status != AllocatorStatusSuccess)			\
+			return (status);				\
+		array = deque->wh_array;				\
+	}								\
+	QUEUE_ATOMIC_STORE(&array->wa_slots[(size_t)bottom & array->wa_mask],\
+	    elm, RELAXED);						\
+	QUEUE_ATOMIC_FENCE(RELEASE);					\
+	QUEUE_ATOMIC_STORE(&deque->wh_bottom, bottom + 1, RELAXED);	\
+	return (AllocatorStatusSuccess);				\
+}									\
+									\
+static __inline __unused WorkStealStatusType				\
+name##_WSDEQUE_POP(struct name *deque, type *elmp)			\
+{									\
+	ptrdiff_t bottom = QUEUE_ATOMIC_LOAD(&deque->wh_bottom, RELAXED) - 1;\
+	WSDEQUE_ARRAY(name) *array = deque->wh_array;			\
+	WorkStealStatusType status = WorkStealStatusSuccess;		\
+	ptrdiff_t top;							\
+	type elm;							\
+									\
+	QUEUE_ATOMIC_STORE(&deque->wh_bottom, bottom, RELAXED);		\
+	QUEUE_ATOMIC_FENCE(SEQ_CST);					\
+	top = QUEUE_ATOMIC_LOAD(&deque->wh_top, RELAXED);		\
+	if (top > bottom) {						\
+		/* Already empty; undo the reservation. */		\
+		QUEUE_ATOMIC_STORE(&deque->wh_bottom, bottom + 1, RELAXED);\
+		return (WorkStealStatusEmpty);				\
+	}								\
+	elm = QUEUE_ATOMIC_LOAD(					\
+	    &array->wa_slots[(size_t)bottom & array->wa_mask], RELAXED);	\
+	if (top == bottom) {						\
+		/* Last element: race thieves for it via top. */	\
+		if (!QUEUE_ATOMIC_CAS(&deque->wh_top, &top, top + 1,	\
+		    SEQ_CST, RELAXED))					\
+			status = WorkStealStatusEmpty;			\
+		QUEUE_ATOMIC_STORE(&deque->wh_bottom, bottom + 1, RELAXED);\
+	}								\
+	if (status == WorkStealStatusSuccess)				\
+		*elmp = elm;						\
+	return (status);						\
+}									\
+									\
+static __inline __unused WorkStealStatusType				\
+name##_WSDEQUE_STEAL(struct name *deque, type *elmp)			\
+{									\
+	ptrdiff_t top = QUEUE_ATOMIC_LOAD(&deque->wh_top, ACQUIRE);	\
+	ptrdiff_t bottom;						\
+	WSDEQUE_ARRAY(name) *array;					\
+	type elm;							\
+									\
+	QUEUE_ATOMIC_FENCE(SEQ_CST);					\
+	bottom = QUEUE_ATOMIC_LOAD(&deque->wh_bottom, ACQUIRE);		\
+	if (top >= bottom)						\
+		return (WorkStealStatusEmpty);				\
+	array = QUEUE_ATOMIC_LOAD(&deque->wh_array, ACQUIRE);		\
+	elm = QUEUE_ATOMIC_LOAD(					\
+	    &array->wa_slots[(size_t)top & array->wa_mask], RELAXED);	\
+	if (!QUEUE_ATOMIC_CAS(&deque->wh_top, &top, top + 1,		\
+	    SEQ_CST, RELAXED))						\
+		return (WorkStealStatusAbort);				\
+	*elmp = elm;							\
+	return (WorkStealStatusSuccess);				\
+}
@@ -31,6 +31,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ******************************************************************************/
 
 #pragma once
+#include <stddef.h>
 #include "../include/InterfaceAPI.h"
 
 /** Mutex status type */
@@ -41,6 +42,9 @@ typedef enum {
 
 typedef const char * CallTrace;
 
+/** CallTrace for the current source location. */
+#define CALL_TRACE	__FILE__ ":" STR( __LINE__ )
+
 /** Signatures for allocating memory. 
  *
  * @param self interface implementation instance.
@@ -62,6 +66,24 @@ typedef const char * CallTrace;
 #define Allocator__signature_free( name )	\
 	AllocatorStatusType (name)( Allocator * const restrict self, void * restrict * const restrict allocationPtr, const CallTrace trace )
 
+// Forward declare Allocator for the resize property type
+INTERFACE_DECLARE( Allocator );
+
+/** Signature for resizing an allocation in place.
+ *
+ * Optional: allocators that cannot resize leave the property NULL. Callers
+ * fall back to allocating, copying and freeing.
+ *
+ * @param self interface implementation instance.
+ * @param allocation memory returned by allocate.
+ * @param size bytes the allocation should now hold.
+ * @param trace debugging trace.
+ * @return AllocatorStatusSuccess if the allocation now holds size bytes at
+ *   the same address, otherwise AllocatorStatusFailure, leaving it as it
+ *   was.
+ */
+typedef AllocatorStatusType (*AllocatorResize)( Allocator * const restrict self, void * const restrict allocation, const size_t size, const CallTrace trace );
+
 /** Allocator vtable xmacro. */
 #define Allocator__vtable_xmacro( EXPAND, ... )	\
 	APPLY( EXPAND, allocate, ## __VA_ARGS__ )	\
@@ -69,7 +91,8 @@ typedef const char * CallTrace;
 
 /** Allocator property xmacro. */
 #define Allocator__property_xmacro( EXPAND, ... )	\
-	APPLY( EXPAND, const char *, name, NULL, ## __VA_ARGS__ )
+	APPLY( EXPAND, const char *, name, NULL, ## __VA_ARGS__ )	\
+	APPLY( EXPAND, AllocatorResize, resize, NULL, ## __VA_ARGS__ )
 
 /** Mutex Factory interface. 
  *
@@ -81,6 +104,7 @@ typedef const char * CallTrace;
  *
  * Properties:
  *  - name
+ *  - resize: in-place resize, or NULL if unsupported.
  */
 INTERFACE_DEFINE( Allocator );
 
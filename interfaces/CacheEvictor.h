@@ -0,0 +1,68 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include "../include/InterfaceAPI.h"
+
+/** Signature for disposing of an entry dropped by a cache.
+ *
+ * Called with the cache's lock, if any, held; implementations must not
+ * call back into the cache.
+ *
+ * @param self interface implementation instance.
+ * @param entry evicted entry. Ownership passes to the callee.
+ * @param cost cost charged for the entry when it was inserted.
+ */
+#define CacheEvictor__signature_evict( name )	\
+	void (name)( CacheEvictor * const restrict self, void * const restrict entry, const size_t cost )
+
+/** CacheEvictor vtable xmacro. */
+#define CacheEvictor__vtable_xmacro( EXPAND, ... )	\
+	APPLY( EXPAND, evict, ## __VA_ARGS__ )
+
+/** CacheEvictor property xmacro. */
+#define CacheEvictor__property_xmacro( EXPAND, ... )	\
+	APPLY( EXPAND, const char *, name, NULL, ## __VA_ARGS__ )
+
+/** CacheEvictor interface.
+ *
+ * Receives entries that a cache drops to stay within capacity, or replaces
+ * with a newer entry for the same key.
+ *
+ * Methods:
+ *  - evict
+ *
+ * Properties:
+ *  - name
+ */
+INTERFACE_DEFINE( CacheEvictor );
@@ -0,0 +1,86 @@
+/******************************************************************************
+
+Copyright (c) 2016, Alexander Haase
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of NotQuiteC nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include "../include/InterfaceAPI.h"
+
+/** Executor status type */
+typedef enum {
+	ExecutorStatusSuccess,
+	ExecutorStatusFailure,
+} ExecutorStatusType;
+
+/** Signature for a unit of parallel work.
+ *
+ * @param context caller's argument, shared by all tasks of a run.
+ * @param index task number, from 0 to count - 1.
+ * @param worker number of the worker running the task, from 0 to workers
+ * - 1. No two tasks run on the same worker at once.
+ */
+typedef void (*ExecutorTask)( void * const context, const size_t index, const size_t worker );
+
+/** Signature for running a batch of tasks to completion.
+ *
+ * Runs task once for each index, spread over the executor's workers, and
+ * returns once all have finished. The calling thread may act as a worker.
+ *
+ * @param self interface implementation instance.
+ * @param task function to run.
+ * @param context argument passed to every task.
+ * @param count number of tasks.
+ * @return appropriate ExecutorStatusType.
+ */
+#define Executor__signature_run( name )	\
+	ExecutorStatusType (name)( Executor * const restrict self, const ExecutorTask task, void * const context, const size_t count )
+
+/** Executor vtable xmacro. */
+#define Executor__vtable_xmacro( EXPAND, ... )	\
+	APPLY( EXPAND, run, ## __VA_ARGS__ )
+
+/** Executor property xmacro. */
+#define Executor__property_xmacro( EXPAND, ... )	\
+	APPLY( EXPAND, const char *, name, NULL, ## __VA_ARGS__ )	\
+	APPLY( EXPAND, size_t, workers, 1, ## __VA_ARGS__ )
+
+/** Executor interface.
+ *
+ * A pool of worker threads that runs batches of independent tasks.
+ *
+ * Methods:
+ *  - run
+ *
+ * Properties:
+ *  - name
+ *  - workers: number of workers, hence of distinct worker numbers.
+ */
+INTERFACE_DEFINE( Executor );